@@ -0,0 +1,79 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "alarm_queue.h"
+
+#define TAG "AlarmQueue"
+
+static AlarmItem q[ALARM_QUEUE_LEN];
+static int q_n = 0;
+static uint32_t q_seq = 0;
+static SemaphoreHandle_t q_lock = NULL;
+static SemaphoreHandle_t q_ready = NULL;   // given on every push
+
+void alarm_queue_init(void) {
+    if (q_lock) return;
+    q_lock = xSemaphoreCreateMutex();
+    q_ready = xSemaphoreCreateBinary();
+}
+
+static void remove_at(int k) {
+    memmove(&q[k], &q[k + 1], (size_t)(q_n - k - 1) * sizeof(AlarmItem));
+    q_n--;
+}
+
+// A reminder is queued at most once, at the most urgent priority seen and
+// the earliest due time.
+bool alarm_queue_push(int id, AlarmPrio prio, int64_t due_us) {
+    xSemaphoreTake(q_lock, portMAX_DELAY);
+    for (int k = 0; k < q_n; k++) {
+        if (q[k].id != id) continue;
+        if (q[k].due_us < due_us) due_us = q[k].due_us;
+        if (q[k].prio <= prio) { q[k].due_us = due_us; xSemaphoreGive(q_lock); return true; }
+        remove_at(k);
+        break;
+    }
+    if (q_n >= ALARM_QUEUE_LEN) {
+        xSemaphoreGive(q_lock);
+        ESP_LOGE(TAG, "Hàng đợi báo thức đầy, bỏ ID %d", id);
+        return false;
+    }
+    AlarmItem it = { .id = id, .prio = (uint8_t)prio, .seq = q_seq++, .due_us = due_us };
+    int k = q_n;
+    while (k > 0 && q[k - 1].prio > it.prio) { q[k] = q[k - 1]; k--; }
+    q[k] = it;
+    q_n++;
+    xSemaphoreGive(q_lock);
+    xSemaphoreGive(q_ready);
+    return true;
+}
+
+bool alarm_queue_pop(AlarmItem *out, TickType_t wait) {
+    for (;;) {
+        xSemaphoreTake(q_lock, portMAX_DELAY);
+        if (q_n > 0) {
+            *out = q[0];
+            remove_at(0);
+            xSemaphoreGive(q_lock);
+            return true;
+        }
+        xSemaphoreGive(q_lock);
+        if (xSemaphoreTake(q_ready, wait) != pdTRUE) return false;
+    }
+}
+
+void alarm_queue_drop(int id) {
+    xSemaphoreTake(q_lock, portMAX_DELAY);
+    for (int k = 0; k < q_n; k++) {
+        if (q[k].id == id) { remove_at(k); break; }
+    }
+    xSemaphoreGive(q_lock);
+}
+
+int alarm_queue_count(void) {
+    xSemaphoreTake(q_lock, portMAX_DELAY);
+    int n = q_n;
+    xSemaphoreGive(q_lock);
+    return n;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+
+// Reminders waiting to ring, highest priority first (FIFO within a
+// priority). Filled by the minute scan and snooze expiry; drained by the
+// alarm task one acknowledgement at a time.
+#define ALARM_QUEUE_LEN 24
+
+typedef enum {
+    ALARM_PRIO_ONESHOT = 0,
+    ALARM_PRIO_REPEAT  = 1,
+    ALARM_PRIO_SNOOZE  = 2,
+} AlarmPrio;
+
+typedef struct {
+    int      id;
+    uint8_t  prio;
+    uint32_t seq;
+    int64_t  due_us;   // wall time it was due, for latency
+} AlarmItem;
+
+void alarm_queue_init(void);
+bool alarm_queue_push(int id, AlarmPrio prio, int64_t due_us);
+bool alarm_queue_pop(AlarmItem *out, TickType_t wait);
+void alarm_queue_drop(int id);
+int  alarm_queue_count(void);
@@ -0,0 +1,83 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+// Integer-only Gregorian calendar for days since 1970-01-01 and the device's
+// fixed local zone (ICT, UTC+7, no DST; see setenv("TZ") in sntp.c). Used in
+// place of localtime_r/mktime on the per-tick and per-redraw paths.
+#define CIVIL_UTC_OFFSET_SECS (7 * 60 * 60)
+#define CIVIL_DAY_SECS        (24 * 60 * 60)
+#define CIVIL_WEEK_MINS       (7 * 24 * 60)
+
+static inline bool civil_is_leap(int y) {
+    return (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+}
+
+static inline int civil_days_in_month(int y, int m) {
+    return (m == 2) ? 28 + civil_is_leap(y) : 30 + ((m + (m >> 3)) & 1);
+}
+
+static inline int32_t days_from_civil(int y, int m, int d) {
+    y -= (m <= 2);
+    int32_t era = (y >= 0 ? y : y - 399) / 400;
+    int32_t yoe = y - era * 400;
+    int32_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int32_t doe = yoe * 365 + yoe/4 - yoe/100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+static inline void civil_from_days(int32_t z, int *y, int *m, int *d) {
+    z += 719468;
+    int32_t era = (z >= 0 ? z : z - 146096) / 146097;
+    int32_t doe = z - era * 146097;
+    int32_t yoe = (doe - doe/1460 + doe/36524 - doe/146096) / 365;
+    int32_t doy = doe - (365*yoe + yoe/4 - yoe/100);
+    int32_t mp  = (5*doy + 2) / 153;
+    *d = doy - (153*mp + 2)/5 + 1;
+    *m = mp < 10 ? mp + 3 : mp - 9;
+    *y = yoe + era * 400 + (*m <= 2);
+}
+
+// Monday = 0; 1970-01-01 was a Thursday.
+static inline int civil_weekday(int32_t day) {
+    return (int)((day % 7 + 10) % 7);
+}
+
+static inline int32_t civil_local_day(time_t t) {
+    int64_t s = (int64_t)t + CIVIL_UTC_OFFSET_SECS;
+    return (int32_t)((s >= 0 ? s : s - (CIVIL_DAY_SECS - 1)) / CIVIL_DAY_SECS);
+}
+
+static inline int civil_local_sec_of_day(time_t t) {
+    return (int)((int64_t)t + CIVIL_UTC_OFFSET_SECS - (int64_t)civil_local_day(t) * CIVIL_DAY_SECS);
+}
+
+static inline int civil_local_min_of_day(time_t t) {
+    return civil_local_sec_of_day(t) / 60;
+}
+
+static inline int civil_minute_of_week(time_t t) {
+    return civil_weekday(civil_local_day(t)) * 24 * 60 + civil_local_min_of_day(t);
+}
+
+static inline time_t civil_to_utc(int32_t day, int min_of_day) {
+    return (time_t)((int64_t)day * CIVIL_DAY_SECS + min_of_day * 60 - CIVIL_UTC_OFFSET_SECS);
+}
+
+// localtime_r for the fixed zone; tm_isdst is always 0.
+static inline void civil_localtime(time_t t, struct tm *out) {
+    int32_t day = civil_local_day(t);
+    int sod = civil_local_sec_of_day(t);
+    int y, m, d;
+    civil_from_days(day, &y, &m, &d);
+    out->tm_year  = y - 1900;
+    out->tm_mon   = m - 1;
+    out->tm_mday  = d;
+    out->tm_hour  = sod / 3600;
+    out->tm_min   = sod / 60 % 60;
+    out->tm_sec   = sod % 60;
+    out->tm_wday  = (civil_weekday(day) + 1) % 7;
+    out->tm_yday  = (int)(day - days_from_civil(y, 1, 1));
+    out->tm_isdst = 0;
+}
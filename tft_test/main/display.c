@@ -7,6 +7,7 @@
 #include "driver/spi_master.h"
 #include "driver/gpio.h"
 #include "esp_log.h"
+#include "display.h"
 
 #define PIN_NUM_MISO   -1  
 #define PIN_NUM_MOSI   9   
@@ -40,6 +41,17 @@
 #define ST7735_DISPON   0x29
 
 static spi_device_handle_t spi;
+static DisplayStats stats;
+
+static inline void count_txn(uint32_t bytes, uint32_t pixels) {
+    stats.txns++;
+    stats.bytes += bytes;
+    stats.pixels += pixels;
+}
+
+void display_stats(DisplayStats *out) {
+    *out = stats;
+}
 
 void send_cmd(uint8_t cmd) {
     esp_err_t ret;
@@ -49,6 +61,7 @@ void send_cmd(uint8_t cmd) {
         .flags = 0
     };
     gpio_set_level(PIN_NUM_DC, 0); 
+    count_txn(1, 0);
     ret = spi_device_polling_transmit(spi, &t);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Write command 0x%02X failed: %s", cmd, esp_err_to_name(ret));
@@ -64,6 +77,7 @@ void send_data(uint8_t *data, uint16_t len) {
         .flags = 0
     };
     gpio_set_level(PIN_NUM_DC, 1); 
+    count_txn(len, 0);
     ret = spi_device_polling_transmit(spi, &t);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Write data (%d bytes) failed: %s", len, esp_err_to_name(ret));
@@ -102,6 +116,7 @@ static void push_color_repeat_chunked(uint16_t color, size_t px_count) {
             .flags     = 0
         };
         gpio_set_level(PIN_NUM_DC, 1);
+        count_txn((uint32_t)(n * 2), (uint32_t)n);
         esp_err_t ret = spi_device_polling_transmit(spi, &t);
         if (ret != ESP_OK) {
             ESP_LOGE(TAG, "push_color_repeat_chunked fail: %s", esp_err_to_name(ret));
@@ -133,6 +148,7 @@ void draw_pixel(uint16_t x, uint16_t y, uint16_t color) {
     if (x >= TFT_WIDTH || y >= TFT_HEIGHT) return;
     uint8_t data[2] = {color >> 8, color & 0xFF};
     set_addr_window(x, y, x, y);
+    stats.pixels++;
     send_data(data, 2);
 }
 
@@ -189,7 +205,7 @@ void init_spi() {
     };
 
     spi_device_interface_config_t devcfg = {
-        .clock_speed_hz = 10 * 1000 * 1000,  
+        .clock_speed_hz = DISPLAY_SPI_HZ,  
         .mode = 0,                         
         .spics_io_num = PIN_NUM_CS,
         .queue_size = 10,                  
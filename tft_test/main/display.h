@@ -21,6 +21,15 @@
 #define COLOR_WHITE  0xFFFF
 #define COLOR_YELLOW 0xFFE0
 
+#define DISPLAY_SPI_HZ (10 * 1000 * 1000)
+
+// Running totals of what has been pushed to the panel, for cost reports.
+typedef struct {
+    uint32_t txns;
+    uint32_t bytes;
+    uint32_t pixels;
+} DisplayStats;
+
 void send_cmd(uint8_t cmd);
 void send_data(uint8_t *data, uint16_t len);
 void set_addr_window(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1);
@@ -31,4 +40,5 @@ void draw_char(char c, int x, int y, uint16_t color);
 void draw_string(uint16_t x, uint16_t y, const char *str, uint16_t color);
 void init_spi(void);
 void test_gpio(void);
-void init_display(void);
\ No newline at end of file
+void init_display(void);
+void display_stats(DisplayStats *out);
\ No newline at end of file
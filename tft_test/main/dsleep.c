@@ -0,0 +1,121 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "driver/rtc_io.h"
+#include "sdkconfig.h"
+#include "civil_time.h"
+#include "ui_buttons.h"
+#include "dsleep.h"
+
+#define TAG "DeepSleep"
+#define DSLEEP_MAGIC    0x44534c31u
+#define DSLEEP_MARGIN_S 3        // kept between measured boot time and lead
+
+typedef struct {
+    uint32_t magic;
+    int64_t  next_fire;     // 0 = none before the window ends
+    int64_t  watermark;
+    uint32_t wakes;
+    uint32_t worst_boot_ms; // wake to scheduler ready
+    int32_t  worst_late_ms; // scheduled fire to alarm screen drawn
+} RtcState;
+
+static RTC_DATA_ATTR RtcState rtc;
+static bool resumed = false;
+static bool offline = false;
+static time_t resume_fire = 0;
+static time_t resume_wm = 0;
+
+static const gpio_num_t wake_pins[] = { BTN_OK_PIN, BTN_BACK_PIN, BTN_NEXT_PIN, BTN_CANCEL_PIN };
+
+bool dsleep_in_window(time_t now) {
+    int h = civil_local_min_of_day(now) / 60;
+    int s = CONFIG_REMINDERS_DEEP_SLEEP_START_H, e = CONFIG_REMINDERS_DEEP_SLEEP_END_H;
+    return (s > e) ? (h >= s || h < e) : (h >= s && h < e);
+}
+
+static time_t window_end(time_t now) {
+    int32_t day = civil_local_day(now);
+    if (civil_local_min_of_day(now) >= CONFIG_REMINDERS_DEEP_SLEEP_END_H * 60) day++;
+    return civil_to_utc(day, CONFIG_REMINDERS_DEEP_SLEEP_END_H * 60);
+}
+
+// The configured lead, stretched if a previous wake needed longer to get
+// the scheduler running; alarms are then still queued on their minute.
+static int lead_s(void) {
+    int lead = CONFIG_REMINDERS_DEEP_SLEEP_LEAD_S;
+    int need = (int)(rtc.worst_boot_ms + 999) / 1000 + DSLEEP_MARGIN_S;
+    return (need > lead) ? need : lead;
+}
+
+void dsleep_boot(void) {
+#if CONFIG_REMINDERS_DEEP_SLEEP
+    esp_sleep_wakeup_cause_t cause = esp_sleep_get_wakeup_cause();
+    if (rtc.magic == DSLEEP_MAGIC && (cause == ESP_SLEEP_WAKEUP_TIMER || cause == ESP_SLEEP_WAKEUP_EXT1)) {
+        resumed = true;
+        resume_fire = (time_t)rtc.next_fire;
+        resume_wm = (time_t)rtc.watermark;
+        rtc.wakes++;
+        offline = dsleep_in_window(time(NULL));
+        ESP_LOGI(TAG, "Thức dậy (%s) lần %u, %s", cause == ESP_SLEEP_WAKEUP_TIMER ? "timer" : "nút",
+                 (unsigned)rtc.wakes, offline ? "không bật Wi-Fi" : "khởi động đầy đủ");
+    } else {
+        memset(&rtc, 0, sizeof(rtc));
+    }
+    // Only this boot may trust the saved state; a later reset starts clean.
+    rtc.magic = 0;
+#endif
+}
+
+bool dsleep_resumed(void) { return resumed; }
+bool dsleep_offline(void) { return offline; }
+
+bool dsleep_rtc_watermark(time_t *wm) {
+    if (!resumed || resume_wm <= 0) return false;
+    *wm = resume_wm;
+    return true;
+}
+
+void dsleep_scheduler_ready(void) {
+    if (!resumed) return;
+    static bool noted = false;
+    if (noted) return;
+    noted = true;
+    uint32_t ms = (uint32_t)(esp_timer_get_time() / 1000);
+    if (ms > rtc.worst_boot_ms) rtc.worst_boot_ms = ms;
+    ESP_LOGI(TAG, "Scheduler sẵn sàng sau %u ms (tệ nhất %u ms, lead %d s)",
+             (unsigned)ms, (unsigned)rtc.worst_boot_ms, lead_s());
+    if (ms / 1000 + DSLEEP_MARGIN_S > (uint32_t)CONFIG_REMINDERS_DEEP_SLEEP_LEAD_S) {
+        ESP_LOGW(TAG, "Khởi động chậm hơn lead cấu hình, lần sau dậy sớm hơn");
+    }
+}
+
+void dsleep_note_alarm(time_t fire_at, int64_t late_us) {
+    if (!resumed || fire_at != resume_fire) return;
+    int32_t late_ms = (int32_t)(late_us / 1000);
+    if (late_ms > rtc.worst_late_ms) rtc.worst_late_ms = late_ms;
+    ESP_LOGI(TAG, "Báo thức sau deep sleep trễ %ld ms (tệ nhất %ld ms)", (long)late_ms, (long)rtc.worst_late_ms);
+}
+
+void dsleep_enter(time_t now, time_t next_fire, time_t wm) {
+    time_t end = window_end(now);
+    time_t wake = end;
+    if (next_fire > 0 && next_fire - lead_s() < end) wake = next_fire - lead_s();
+    if (wake <= now) wake = now + 1;
+    rtc.next_fire = (next_fire > 0 && next_fire <= end) ? next_fire : 0;
+    rtc.watermark = wm;
+    rtc.magic = DSLEEP_MAGIC;
+    uint64_t mask = 0;
+    for (int k = 0; k < 4; k++) {
+        mask |= 1ULL << wake_pins[k];
+        rtc_gpio_pullup_en(wake_pins[k]);
+        rtc_gpio_pulldown_dis(wake_pins[k]);
+    }
+    esp_sleep_pd_config(ESP_PD_DOMAIN_RTC_PERIPH, ESP_PD_OPTION_ON);
+    ESP_ERROR_CHECK(esp_sleep_enable_ext1_wakeup(mask, ESP_EXT1_WAKEUP_ANY_LOW));
+    ESP_ERROR_CHECK(esp_sleep_enable_timer_wakeup((uint64_t)(wake - now) * 1000000ULL));
+    ESP_LOGI(TAG, "Deep sleep %ld s (báo thức kế tiếp %lld)", (long)(wake - now), (long long)rtc.next_fire);
+    esp_deep_sleep_start();
+}
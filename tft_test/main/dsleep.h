@@ -0,0 +1,19 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+// Night-time deep sleep for battery units (CONFIG_REMINDERS_DEEP_SLEEP).
+// The next fire instant and the due-index watermark are kept in RTC slow
+// memory; the RTC timer wakes the chip a lead time ahead of the alarm (or
+// at the end of the night window) and any button wakes it through ext1.
+// A wake that lands inside the window resumes without Wi-Fi/MQTT and
+// restarts into a full boot once the window is over.
+void dsleep_boot(void);                 // first thing in app_main
+bool dsleep_resumed(void);              // this boot is a wake from dsleep_enter
+bool dsleep_offline(void);              // resumed inside the night window
+bool dsleep_rtc_watermark(time_t *wm);
+bool dsleep_in_window(time_t now);
+void dsleep_scheduler_ready(void);      // print_time_task is about to scan
+void dsleep_note_alarm(time_t fire_at, int64_t late_us);   // alarm screen drawn
+void dsleep_enter(time_t now, time_t next_fire, time_t wm);   // does not return
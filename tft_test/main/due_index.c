@@ -0,0 +1,133 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#include <time.h>
+#include "esp_log.h"
+#include "nvs.h"
+#include "reminders_store.h"
+#include "due_index.h"
+
+#define TAG "DueIndex"
+
+// Sorted by fire time (ties keep insertion order); guarded by reminders_mutex.
+static DueEntry due_q[MAX_REMINDERS];
+static int due_n = 0;
+static volatile bool due_stale = true;
+static time_t due_wm = 0;
+
+static void insert_locked(time_t at, int id) {
+    if (due_n >= MAX_REMINDERS) {
+        ESP_LOGE(TAG, "Index đầy, bỏ qua ID %d", id);
+        return;
+    }
+    int lo = 0, hi = due_n;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (due_q[mid].at <= at) lo = mid + 1; else hi = mid;
+    }
+    memmove(&due_q[lo + 1], &due_q[lo], (size_t)(due_n - lo) * sizeof(DueEntry));
+    due_q[lo].at = at;
+    due_q[lo].id = id;
+    due_n++;
+}
+
+void due_index_invalidate(void) {
+    due_stale = true;
+}
+
+void due_index_rebuild_locked(time_t now) {
+    due_n = 0;
+    for (int i = 0; i < num_reminders; i++) {
+        time_t at = reminder_next_fire(&reminders[i], now);
+        if (at >= 0) insert_locked(at, reminders[i].id);
+    }
+    due_stale = false;
+    ESP_LOGI(TAG, "Rebuilt due index: %d/%d reminders", due_n, num_reminders);
+}
+
+void due_index_remove_locked(int id) {
+    for (int k = 0; k < due_n; k++) {
+        if (due_q[k].id == id) {
+            memmove(&due_q[k], &due_q[k + 1], (size_t)(due_n - k - 1) * sizeof(DueEntry));
+            due_n--;
+            return;
+        }
+    }
+}
+
+// Occurrences before the watermark were already handed out; an edit in the
+// minute an alarm rang must not queue that same occurrence again.
+void due_index_upsert_locked(int id, time_t now) {
+    if (due_stale) return;
+    due_index_remove_locked(id);
+    int idx = reminder_index_by_id_locked(id);
+    if (idx < 0) return;
+    time_t at = reminder_next_fire(&reminders[idx], (due_wm > now) ? due_wm : now);
+    if (at >= 0) insert_locked(at, id);
+}
+
+// Past entries are left for due_index_take_locked; only staleness is
+// resolved here.
+void due_index_advance_locked(time_t now) {
+    if (due_stale) due_index_rebuild_locked((due_wm > 0) ? due_wm : now);
+}
+
+time_t due_index_watermark_locked(void) {
+    return due_wm;
+}
+
+void due_index_set_watermark_locked(time_t wm) {
+    due_wm = wm;
+    due_stale = true;
+}
+
+// Pops every entry due before until (at most max; the rest stay for the
+// next call), re-inserting repeats at their next occurrence from until.
+int due_index_take_locked(time_t until, DueEntry *out, int max) {
+    due_index_advance_locked(until);
+    int n = 0;
+    while (due_n > 0 && due_q[0].at < until && n < max) {
+        DueEntry e = due_q[0];
+        memmove(&due_q[0], &due_q[1], (size_t)(due_n - 1) * sizeof(DueEntry));
+        due_n--;
+        out[n++] = e;
+        int idx = reminder_index_by_id_locked(e.id);
+        if (idx >= 0 && reminders[idx].status == REM_STATUS_REPEAT) {
+            e.at = reminder_next_fire(&reminders[idx], until);
+            if (e.at >= 0) insert_locked(e.at, e.id);
+        }
+    }
+    if (due_n == 0 || due_q[0].at >= until) due_wm = until;
+    return n;
+}
+
+time_t due_index_load_watermark(void) {
+    nvs_handle_t h;
+    int64_t wm = 0;
+    if (nvs_open("reminders", NVS_READONLY, &h) != ESP_OK) return 0;
+    if (nvs_get_i64(h, "watermark", &wm) != ESP_OK) wm = 0;
+    nvs_close(h);
+    return (time_t)wm;
+}
+
+void due_index_save_watermark(time_t wm) {
+    nvs_handle_t h;
+    esp_err_t err = nvs_open("reminders", NVS_READWRITE, &h);
+    if (err == ESP_OK) {
+        err = nvs_set_i64(h, "watermark", (int64_t)wm);
+        if (err == ESP_OK) err = nvs_commit(h);
+        nvs_close(h);
+    }
+    if (err != ESP_OK) ESP_LOGW(TAG, "Không lưu được watermark: %s", esp_err_to_name(err));
+}
+
+bool due_index_peek_locked(DueEntry *out) {
+    if (due_stale || due_n == 0) return false;
+    if (out) *out = due_q[0];
+    return true;
+}
+
+int due_index_view_locked(const DueEntry **out) {
+    if (out) *out = due_q;
+    return due_stale ? 0 : due_n;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <stdbool.h>
+#include <time.h>
+
+typedef struct {
+    time_t at;
+    int    id;
+} DueEntry;
+
+void due_index_invalidate(void);
+void due_index_rebuild_locked(time_t now);
+void due_index_upsert_locked(int id, time_t now);
+void due_index_remove_locked(int id);
+void due_index_advance_locked(time_t now);
+bool due_index_peek_locked(DueEntry *out);
+int  due_index_view_locked(const DueEntry **out);
+
+// The watermark is the first instant not yet handed out by
+// due_index_take_locked. A stale index is rebuilt from it, so fire times
+// missed while rebooting, unsynced or across a clock jump stay queued
+// until taken. It survives reboots in NVS.
+time_t due_index_watermark_locked(void);
+void   due_index_set_watermark_locked(time_t wm);
+int    due_index_take_locked(time_t until, DueEntry *out, int max);
+time_t due_index_load_watermark(void);
+void   due_index_save_watermark(time_t wm);
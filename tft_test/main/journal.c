@@ -0,0 +1,147 @@
+#include <stddef.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "journal.h"
+
+#define TAG "Journal"
+#define JOURNAL_SECTOR_SIZE 4096
+#define REC_PER_SECTOR      (JOURNAL_SECTOR_SIZE / (int)sizeof(JournalRecord))
+#define SEQ_ERASED          0xFFFFFFFFu
+
+_Static_assert(sizeof(JournalRecord) == 80, "JournalRecord layout is stored on flash");
+
+static const esp_partition_t *part = NULL;
+static int      n_sectors = 0;
+static int      head_sector = -1;   // sector appends go to
+static int      head_pos = 0;       // next free record slot in head_sector
+static uint32_t next_seq = 1;
+static bool     have_state = false;
+
+static uint32_t rec_crc(const JournalRecord *r) {
+    return esp_rom_crc32_le(0, (const uint8_t *)r, offsetof(JournalRecord, crc));
+}
+
+static size_t rec_offset(int sector, int pos) {
+    return (size_t)sector * JOURNAL_SECTOR_SIZE + (size_t)pos * sizeof(JournalRecord);
+}
+
+static esp_err_t rec_read(int sector, int pos, JournalRecord *r) {
+    return esp_partition_read(part, rec_offset(sector, pos), r, sizeof(*r));
+}
+
+static bool rec_valid(const JournalRecord *r) {
+    return r->seq != SEQ_ERASED && r->crc == rec_crc(r);
+}
+
+static esp_err_t rec_write(int sector, int pos, JournalRecord *r) {
+    r->seq = next_seq++;
+    r->crc = rec_crc(r);
+    return esp_partition_write(part, rec_offset(sector, pos), r, sizeof(*r));
+}
+
+// Returns the sector header seq, or 0 when the sector holds no valid header.
+// *complete is set when a CKPT_END was found, *end to the first erased slot.
+static uint32_t sector_scan(int sector, bool *complete, int *end, uint32_t *max_seq) {
+    JournalRecord r = {0};
+    *complete = false;
+    *end = REC_PER_SECTOR;
+    esp_err_t err = rec_read(sector, 0, &r);
+    if (err != ESP_OK || !rec_valid(&r) || r.op != JOURNAL_OP_SECTOR ||
+        r.id != JOURNAL_FORMAT_VERSION) {
+        *end = (err == ESP_OK && r.seq == SEQ_ERASED) ? 0 : REC_PER_SECTOR;
+        return 0;
+    }
+    uint32_t hdr_seq = r.seq;
+    if (r.seq > *max_seq) *max_seq = r.seq;
+    for (int pos = 1; pos < REC_PER_SECTOR; pos++) {
+        if (rec_read(sector, pos, &r) != ESP_OK) break;
+        if (r.seq == SEQ_ERASED) { *end = pos; break; }
+        if (!rec_valid(&r)) continue;
+        if (r.seq > *max_seq) *max_seq = r.seq;
+        if (r.op == JOURNAL_OP_CKPT_END) *complete = true;
+    }
+    return hdr_seq;
+}
+
+esp_err_t journal_init(void) {
+    if (part) return ESP_OK;
+    const esp_partition_t *p = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                        JOURNAL_PARTITION_SUBTYPE,
+                                                        JOURNAL_PARTITION_LABEL);
+    if (!p) {
+        ESP_LOGW(TAG, "Không tìm thấy phân vùng '%s', dùng NVS", JOURNAL_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+    part = p;
+    n_sectors = (int)(part->size / JOURNAL_SECTOR_SIZE);
+    uint32_t best = 0, max_seq = 0;
+    for (int s = 0; s < n_sectors; s++) {
+        bool complete; int end;
+        uint32_t hdr = sector_scan(s, &complete, &end, &max_seq);
+        if (hdr && complete && hdr > best) {
+            best = hdr;
+            head_sector = s;
+            head_pos = end;
+        }
+    }
+    next_seq = max_seq + 1;
+    have_state = (best != 0);
+    if (!have_state) head_sector = n_sectors - 1;
+    ESP_LOGI(TAG, "Journal: %d sector, head %d/%d, seq %u",
+             n_sectors, head_sector, head_pos, (unsigned)next_seq);
+    return ESP_OK;
+}
+
+bool journal_available(void) { return part != NULL; }
+
+bool journal_has_state(void) { return have_state; }
+
+int journal_free_records(void) {
+    if (!part || !have_state) return 0;
+    return REC_PER_SECTOR - head_pos;
+}
+
+esp_err_t journal_replay(journal_apply_fn apply, void *ctx) {
+    if (!part || !have_state) return ESP_ERR_INVALID_STATE;
+    JournalRecord r;
+    for (int pos = 1; pos < head_pos; pos++) {
+        esp_err_t err = rec_read(head_sector, pos, &r);
+        if (err != ESP_OK) return err;
+        if (rec_valid(&r)) apply(&r, ctx);
+    }
+    return ESP_OK;
+}
+
+esp_err_t journal_append(JournalRecord *rec) {
+    if (!part || !have_state) return ESP_ERR_INVALID_STATE;
+    if (head_pos >= REC_PER_SECTOR) return ESP_ERR_NO_MEM;
+    esp_err_t err = rec_write(head_sector, head_pos, rec);
+    head_pos++;   // a failed write may have left bytes behind; never reuse the slot
+    return err;
+}
+
+// Compaction: the next sector gets a fresh copy of the live state. The old
+// head stays intact until this checkpoint's CKPT_END is on flash.
+esp_err_t journal_checkpoint(JournalRecord *recs, int n) {
+    if (!part) return ESP_ERR_INVALID_STATE;
+    if (n + 2 > REC_PER_SECTOR) return ESP_ERR_INVALID_SIZE;
+    int s = (head_sector + 1) % n_sectors;
+    esp_err_t err = esp_partition_erase_range(part, (size_t)s * JOURNAL_SECTOR_SIZE, JOURNAL_SECTOR_SIZE);
+    if (err != ESP_OK) return err;
+    JournalRecord hdr = { .op = JOURNAL_OP_SECTOR, .id = JOURNAL_FORMAT_VERSION };
+    err = rec_write(s, 0, &hdr);
+    for (int i = 0; err == ESP_OK && i < n; i++) err = rec_write(s, 1 + i, &recs[i]);
+    JournalRecord end = { .op = JOURNAL_OP_CKPT_END };
+    if (err == ESP_OK) err = rec_write(s, 1 + n, &end);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Checkpoint sector %d lỗi: %s", s, esp_err_to_name(err));
+        return err;
+    }
+    head_sector = s;
+    head_pos = n + 2;
+    have_state = true;
+    ESP_LOGI(TAG, "Checkpoint %d bản ghi vào sector %d", n, s);
+    return ESP_OK;
+}
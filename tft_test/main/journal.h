@@ -0,0 +1,45 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "mqtt.h"
+
+// Raw data partition used as a ring of sectors. Each sector starts with a
+// SECTOR header and a full checkpoint (PUT.. + META + CKPT_END), followed by
+// appended ops; boot replays the newest sector whose checkpoint completed.
+// HISTORY records are not carried over by checkpoints, so older sectors keep
+// the recent alarm history until the ring wraps.
+#define JOURNAL_PARTITION_LABEL   "journal"
+#define JOURNAL_PARTITION_SUBTYPE 0x40
+#define JOURNAL_FORMAT_VERSION    1
+
+typedef enum {
+    JOURNAL_OP_SECTOR   = 1,   // id carries JOURNAL_FORMAT_VERSION
+    JOURNAL_OP_PUT      = 2,
+    JOURNAL_OP_DEL      = 3,
+    JOURNAL_OP_META     = 4,   // id carries next_id
+    JOURNAL_OP_CKPT_END = 5,
+    JOURNAL_OP_HISTORY  = 6,   // content carries the history message
+    JOURNAL_OP_RULE     = 7,   // follows a PUT: status = kind, min_of_day = arg, day = until
+} JournalOp;
+
+typedef struct {
+    uint32_t seq;
+    uint8_t  op;
+    uint8_t  status;
+    uint16_t id;
+    uint16_t day;
+    uint16_t min_of_day;
+    char     content[CONTENT_LENGTH];
+    uint32_t crc;
+} JournalRecord;
+
+typedef void (*journal_apply_fn)(const JournalRecord *rec, void *ctx);
+
+esp_err_t journal_init(void);
+bool journal_available(void);
+bool journal_has_state(void);
+esp_err_t journal_replay(journal_apply_fn apply, void *ctx);
+int  journal_free_records(void);
+esp_err_t journal_append(JournalRecord *rec);
+esp_err_t journal_checkpoint(JournalRecord *recs, int n);
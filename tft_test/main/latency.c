@@ -0,0 +1,119 @@
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "cJSON.h"
+#include "mqtt.h"
+#include "scheduler.h"
+#include "timer_wheel.h"
+#include "latency.h"
+
+#define TAG "Latency"
+#define LAT_REPORT_S 3600
+
+typedef struct {
+    uint32_t b[LAT_BUCKETS];
+    uint32_t n;
+    uint32_t max_ms;
+} LatHist;
+
+enum { LAT_LDR = UI_STATE_COUNT + ALARM_PRIO_SNOOZE + 1, LAT_COUNT };
+
+static const char *const LAT_NAMES[LAT_COUNT] = {
+    [UI_IDLE] = "idle", [UI_MENU] = "menu", [UI_VIEW_LIST] = "view_list",
+    [UI_EDIT_PICK] = "edit_pick", [UI_EDIT_SUBMENU] = "edit_submenu",
+    [UI_EDIT_CONTENT] = "edit_content", [UI_EDIT_DATE] = "edit_date",
+    [UI_EDIT_TIME] = "edit_time", [UI_ADD_CONTENT] = "add_content",
+    [UI_ADD_DATE] = "add_date", [UI_ADD_TIME] = "add_time",
+    [UI_DEL_PICK] = "del_pick", [UI_VIEW_DETAIL] = "view_detail",
+    [UI_STATE_COUNT + ALARM_PRIO_ONESHOT] = "oneshot",
+    [UI_STATE_COUNT + ALARM_PRIO_REPEAT]  = "repeat",
+    [UI_STATE_COUNT + ALARM_PRIO_SNOOZE]  = "snooze",
+    [LAT_LDR] = "ldr",
+};
+
+static LatHist hists[LAT_COUNT];
+static portMUX_TYPE lat_lock = portMUX_INITIALIZER_UNLOCKED;
+static TwTimer report_timer;
+static volatile bool report_due = false;
+
+static void note(int h, int64_t us) {
+    uint32_t ms = (us <= 0) ? 0 : (uint32_t)((us / 1000 > UINT32_MAX) ? UINT32_MAX : us / 1000);
+    int k = ms ? 32 - __builtin_clz(ms) : 0;
+    if (k >= LAT_BUCKETS) k = LAT_BUCKETS - 1;
+    portENTER_CRITICAL(&lat_lock);
+    LatHist *lh = &hists[h];
+    lh->b[k]++;
+    lh->n++;
+    if (ms > lh->max_ms) lh->max_ms = ms;
+    portEXIT_CRITICAL(&lat_lock);
+}
+
+void latency_note_ui(UiState s, int64_t us) {
+    if (s < UI_STATE_COUNT) note(s, us);
+}
+
+void latency_note_alarm(AlarmPrio prio, int64_t us) {
+    if (prio <= ALARM_PRIO_SNOOZE) note(UI_STATE_COUNT + prio, us);
+}
+
+void latency_note_ldr(int64_t us) {
+    note(LAT_LDR, us);
+}
+
+// Upper edge of the bucket holding the p-th percentile, in ms.
+static uint32_t percentile(const LatHist *lh, uint32_t p) {
+    uint32_t want = (lh->n * p + 99) / 100, seen = 0;
+    for (int k = 0; k < LAT_BUCKETS - 1; k++) {
+        seen += lh->b[k];
+        if (seen >= want) return 1u << k;
+    }
+    return lh->max_ms;
+}
+
+void latency_publish(bool reset) {
+    static LatHist snap[LAT_COUNT];
+    portENTER_CRITICAL(&lat_lock);
+    memcpy(snap, hists, sizeof(snap));
+    if (reset) memset(hists, 0, sizeof(hists));
+    portEXIT_CRITICAL(&lat_lock);
+
+    cJSON *json = cJSON_CreateObject();
+    for (int h = 0; h < LAT_COUNT; h++) {
+        const LatHist *lh = &snap[h];
+        if (!lh->n) continue;
+        cJSON *o = cJSON_AddObjectToObject(json, LAT_NAMES[h]);
+        cJSON_AddNumberToObject(o, "n", lh->n);
+        cJSON_AddNumberToObject(o, "p50", percentile(lh, 50));
+        cJSON_AddNumberToObject(o, "p90", percentile(lh, 90));
+        cJSON_AddNumberToObject(o, "p99", percentile(lh, 99));
+        cJSON_AddNumberToObject(o, "max", lh->max_ms);
+        cJSON_AddItemToObject(o, "b", cJSON_CreateIntArray((const int *)lh->b, LAT_BUCKETS));
+    }
+    char *str = cJSON_PrintUnformatted(json);
+    if (str) {
+        mqtt_publish("reminders/latency", str, 0, 0);
+        free(str);
+    } else {
+        ESP_LOGE(TAG, "Không thể tạo JSON string");
+    }
+    cJSON_Delete(json);
+}
+
+// The wheel task must not block on the network; print_time_task publishes.
+static void report(TwTimer *t, void *arg) {
+    report_due = true;
+    sched_kick();
+    tw_arm(t, LAT_REPORT_S);
+}
+
+void latency_poll(void) {
+    if (!report_due) return;
+    report_due = false;
+    latency_publish(true);
+}
+
+void latency_init(void) {
+    tw_init_timer(&report_timer, report, NULL);
+    tw_arm(&report_timer, LAT_REPORT_S);
+}
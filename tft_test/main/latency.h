@@ -0,0 +1,21 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "alarm_queue.h"
+#include "ui_draw.h"
+
+// Input-to-photon latency as log2-bucketed histograms: bucket k counts
+// samples of [2^(k-1), 2^k) ms, bucket 0 under 1 ms, the last one open.
+// Recorded per UI state (button edge to last SPI byte of the redraw), per
+// alarm path (due time to alarm screen drawn) and for the LDR swipe
+// (gesture to feedback drawn). Published hourly on reminders/latency and
+// reset; {"action":"latency"} on reminders/latency/get publishes without
+// resetting.
+#define LAT_BUCKETS 16
+
+void latency_init(void);
+void latency_note_ui(UiState s, int64_t us);
+void latency_note_alarm(AlarmPrio prio, int64_t us);
+void latency_note_ldr(int64_t us);
+void latency_publish(bool reset);
+void latency_poll(void);
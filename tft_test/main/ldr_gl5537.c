@@ -130,6 +130,7 @@ void ldr_gl5537_set_enabled(ldr_gl5537_t *ldr, bool enabled) {
     }
     ldr->enabled = enabled;
     xSemaphoreGive(ldr->mutex);
+    if (enabled && ldr->scan_task) xTaskNotifyGive(ldr->scan_task);
     ESP_LOGI(TAG, "LDR scanning %s", enabled ? "enabled" : "disabled");
 }
 
@@ -210,7 +211,10 @@ void ldr_gl5537_handle_gesture(ldr_gl5537_t *ldr, int ldr_value) {
 void ldr_gl5537_task(void *pvParameters) {
     ldr_gl5537_t *ldr = (ldr_gl5537_t *)pvParameters;
     LDR_CHECK_VOID(ldr, "Invalid LDR pointer in task");
+    ldr->scan_task = xTaskGetCurrentTaskHandle();
     while (1) {
+        // No ADC reads or wakeups at all while the gesture sensor is off.
+        while (!ldr->enabled) ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
         int ldr_value = ldr_gl5537_read_adc(ldr);
         if (ldr_value >= 0) {
             ldr_gl5537_handle_gesture(ldr, ldr_value);
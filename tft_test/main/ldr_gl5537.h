@@ -34,6 +34,7 @@ typedef struct {
     bool is_below_threshold;              
     bool enabled;                         
     SemaphoreHandle_t mutex;             
+    TaskHandle_t scan_task;               // parked while disabled
     ldr_gesture_callback_t gesture_callback; 
 } ldr_gl5537_t;
 
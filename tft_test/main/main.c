@@ -5,6 +5,11 @@
 #include "wifi_app.h"
 #include "sntp.h"
 #include "reminders_store.h"
+#include "timer_wheel.h"
+#include "time_service.h"
+#include "power.h"
+#include "latency.h"
+#include "dsleep.h"
 #include "freertos/task.h"
 #include "esp_log.h"
 #include "esp_system.h"
@@ -28,6 +33,15 @@
 #define MAIN_TASK_PRIORITY 6 
 #define MAIN_TASK_CORE_ID 0
 
+static void start_print_time_task(void) {
+    BaseType_t ret = xTaskCreatePinnedToCore(print_time_task, "print_time", TIME_SYNC_TASK_STACK_SIZE, NULL, TIME_SYNC_TASK_PRIORITY, NULL, TIME_SYNC_TASK_CORE_ID);
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create print time task: %d", ret);
+    } else {
+        ESP_LOGI(TAG, "Print time task created successfully");
+    }
+}
+
 void main_task(void *pvParam) {
 	
     ESP_LOGI(TAG, "Main task started");
@@ -41,12 +55,7 @@ void main_task(void *pvParam) {
         obtain_time();
         ESP_LOGI(TAG, "Free heap after obtain_time: %lu bytes", (unsigned long)esp_get_free_heap_size());
         ESP_LOGI(TAG, "Creating print time task");
-        BaseType_t ret = xTaskCreatePinnedToCore(print_time_task, "print_time", TIME_SYNC_TASK_STACK_SIZE, NULL, TIME_SYNC_TASK_PRIORITY, NULL, TIME_SYNC_TASK_CORE_ID);
-        if (ret != pdPASS) {
-            ESP_LOGE(TAG, "Failed to create print time task: %d", ret);
-        } else {
-            ESP_LOGI(TAG, "Print time task created successfully");
-        }
+        start_print_time_task();
     } else {
         ESP_LOGE(TAG, "Wi-Fi not connected, skipping SNTP and task creation");
     }
@@ -60,6 +69,7 @@ void main_task(void *pvParam) {
 }
 
 void app_main(void) {
+    dsleep_boot();
 	esp_err_t err = nvs_flash_init();
     if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
         ESP_LOGW(TAG, "Khởi tạo lại NVS");
@@ -67,6 +77,12 @@ void app_main(void) {
         nvs_flash_init();
     }
     load_reminders_from_nvs();
+    reminders_persist_start();
+    reminders_store_start();
+    tw_start();
+    timesvc_start();
+    power_init();
+    latency_init();
 	ESP_LOGI(TAG, "Application started");
     ESP_LOGI(TAG, "Free heap before app_main: %lu bytes", (unsigned long)esp_get_free_heap_size());
     ESP_LOGI(TAG, "Minimum free heap: %lu bytes", (unsigned long)esp_get_minimum_free_heap_size());
@@ -83,6 +99,12 @@ void app_main(void) {
         ESP_LOGE(TAG, "Failed to create UI task: %d", ret_ui);
     }
 
+    // Woken at night by the RTC timer or a button: the clock survived deep
+    // sleep, so go straight to the scheduler and leave the radio off.
+    if (dsleep_offline()) {
+        start_print_time_task();
+        return;
+    }
     BaseType_t ret = xTaskCreatePinnedToCore(
         main_task, "main_task",
         MAIN_TASK_STACK_SIZE, NULL,
@@ -2,6 +2,7 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <string.h>
+#include <stdlib.h>
 #include "esp_wifi.h"
 #include "esp_system.h"
 #include "esp_event.h"
@@ -17,15 +18,21 @@
 #include "mqtt_client.h"
 #include "cJSON.h"
 #include "sntp.h"
+#include "vclock.h"
+#include "ui_trace.h"
+#include "latency.h"
 
 static const char *TAG = "MQTT";
 
-extern void add_reminder_full(int id, const char *date, int hour, int min, const char *content, const char *status);
+// Bulk imports arrive as one message; keep the client buffer at least this big.
+#define MQTT_MAX_PAYLOAD 4096
+
+extern void add_reminder_full(int id, const char *date, int hour, int min, const char *content, ReminderStatus status);
 extern void delete_reminder_at(int index);
-extern void update_reminder_status(int id, const char *status);
+extern void update_reminder_status(int id, ReminderStatus status);
 extern void send_reminder_history(const char *content);
-extern void sync_reminder(const char *action, int id, const char *date, const char *time, const char *content, const char *status);
-extern void update_reminder(int id, const char *date, int hour, int min, const char *content, const char *status);
+extern void sync_reminder(const char *action, int id, const char *date, const char *time, const char *content, const char *status, const char *rule);
+extern void update_reminder(int id, const char *date, int hour, int min, const char *content, ReminderStatus status);
 
 static esp_mqtt_client_handle_t mqtt_client = NULL;
 
@@ -66,6 +73,18 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
         ESP_LOGI(TAG, "Subscribed to reminders/status, msg_id=%d", msg_id);
         msg_id = esp_mqtt_client_subscribe(client, "reminders/history", 0);
         ESP_LOGI(TAG, "Subscribed to reminders/history, msg_id=%d", msg_id);
+        msg_id = esp_mqtt_client_subscribe(client, "reminders/bulk", 0);
+        ESP_LOGI(TAG, "Subscribed to reminders/bulk, msg_id=%d", msg_id);
+        msg_id = esp_mqtt_client_subscribe(client, "reminders/latency/get", 0);
+        ESP_LOGI(TAG, "Subscribed to reminders/latency/get, msg_id=%d", msg_id);
+#if CONFIG_REMINDERS_VCLOCK_SIM
+        msg_id = esp_mqtt_client_subscribe(client, "reminders/clock", 0);
+        ESP_LOGI(TAG, "Subscribed to reminders/clock, msg_id=%d", msg_id);
+#endif
+#if CONFIG_REMINDERS_UI_TRACE
+        msg_id = esp_mqtt_client_subscribe(client, "reminders/ui", 0);
+        ESP_LOGI(TAG, "Subscribed to reminders/ui, msg_id=%d", msg_id);
+#endif
         break;
     case MQTT_EVENT_DISCONNECTED:
         ESP_LOGI(TAG, "MQTT_EVENT_DISCONNECTED");
@@ -83,21 +102,23 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
         ESP_LOGI(TAG, "MQTT_EVENT_DATA");
         ESP_LOGI(TAG, "Nhận MQTT data, topic=%.*s, data=%.*s", 
                  event->topic_len, event->topic, event->data_len, event->data);
-        if (event->data_len >= 256) {
-            ESP_LOGE(TAG, "Dữ liệu MQTT quá lớn: %d bytes", event->data_len);
+        if (event->data_len >= MQTT_MAX_PAYLOAD || event->data_len != event->total_data_len) {
+            ESP_LOGE(TAG, "Dữ liệu MQTT quá lớn: %d bytes", event->total_data_len);
             return;
         }
-        char data[256];
-        strncpy(data, event->data, event->data_len);
+        char *data = malloc(event->data_len + 1);
+        if (!data) return;
+        memcpy(data, event->data, event->data_len);
         data[event->data_len] = '\0';
-        ESP_LOGI(TAG, "Dữ liệu MQTT copy: %s", data);
         
         cJSON *json = cJSON_Parse(data);
         if (!json || json->type == cJSON_Invalid) {
             ESP_LOGE(TAG, "Lỗi parse JSON: %s", data);
             cJSON_Delete(json);
+            free(data);
             return;
         }
+        free(data);
         ESP_LOGI(TAG, "Parse JSON thành công");
         
         cJSON *action = cJSON_GetObjectItem(json, "action");
@@ -106,10 +127,31 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
         cJSON *time = cJSON_GetObjectItem(json, "time");
         cJSON *content = cJSON_GetObjectItem(json, "content");
         cJSON *status = cJSON_GetObjectItem(json, "status");
+        const char *rule = cJSON_GetStringValue(cJSON_GetObjectItem(json, "rule"));
         
         if (action && cJSON_IsString(action)) {
             ESP_LOGI(TAG, "Action=%s", action->valuestring);
-            if (strcmp(action->valuestring, "add") == 0) {
+            if (strcmp(action->valuestring, "bulk") == 0) {
+                sync_reminders_bulk(cJSON_GetObjectItem(json, "ops"));
+            } else if (strcmp(action->valuestring, "latency") == 0) {
+                latency_publish(false);
+#if CONFIG_REMINDERS_VCLOCK_SIM
+            } else if (strcmp(action->valuestring, "clock") == 0) {
+                cJSON *at = cJSON_GetObjectItem(json, "at");
+                cJSON *rate = cJSON_GetObjectItem(json, "rate");
+                if (cJSON_IsNumber(rate)) vclock_set_rate((uint32_t)rate->valuedouble);
+                if (cJSON_IsNumber(at)) vclock_set((time_t)at->valuedouble);
+#endif
+#if CONFIG_REMINDERS_UI_TRACE
+            } else if (strcmp(action->valuestring, "ui_trace") == 0) {
+                ui_trace_publish();
+            } else if (strcmp(action->valuestring, "ui_replay") == 0) {
+                cJSON *speed = cJSON_GetObjectItem(json, "speed");
+                if (!ui_trace_replay(cJSON_GetObjectItem(json, "events"), cJSON_IsNumber(speed) ? speed->valueint : 1)) {
+                    ESP_LOGE(TAG, "Không thể phát lại chuỗi nút");
+                }
+#endif
+            } else if (strcmp(action->valuestring, "add") == 0) {
                 if (!date || !time || !content || !status) {
                     ESP_LOGE(TAG, "Thiếu trường bắt buộc: date=%s, time=%s, content=%s, status=%s",
                              date ? date->valuestring : "null",
@@ -121,16 +163,16 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
                 }
                 sync_reminder(action->valuestring, -1, 
                              date->valuestring, time->valuestring, 
-                             content->valuestring, status->valuestring);
+                             content->valuestring, status->valuestring, rule);
             } else if (strcmp(action->valuestring, "delete") == 0 && id && cJSON_IsNumber(id)) {
-                sync_reminder(action->valuestring, id->valueint, NULL, NULL, NULL, NULL);
+                sync_reminder(action->valuestring, id->valueint, NULL, NULL, NULL, NULL, NULL);
             } else if (strcmp(action->valuestring, "update") == 0 && id && cJSON_IsNumber(id)) {
-                sync_reminder(action->valuestring, id->valueint, date->valuestring, time->valuestring, content->valuestring, status->valuestring);
+                sync_reminder(action->valuestring, id->valueint, date->valuestring, time->valuestring, content->valuestring, status->valuestring, rule);
             } else {
                 ESP_LOGE(TAG, "Action hoặc id không hợp lệ");
             }
         } else {
-            ESP_LOGE(TAG, "JSON thiếu action: %s", data);
+            ESP_LOGE(TAG, "JSON thiếu action: %.*s", event->data_len, event->data);
         }
         cJSON_Delete(json);
         break;
@@ -146,6 +188,7 @@ void mqtt_app_start(void)
     esp_mqtt_client_config_t mqtt_cfg = {
         .broker.address.uri = "mqtt://broker.hivemq.com",
         .broker.address.port = 1883,
+        .buffer.size = MQTT_MAX_PAYLOAD,
     };
     mqtt_client = esp_mqtt_client_init(&mqtt_cfg);
     esp_mqtt_client_register_event(mqtt_client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
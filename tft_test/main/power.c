@@ -0,0 +1,56 @@
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "sdkconfig.h"
+#include "timer_wheel.h"
+#include "power.h"
+
+#define TAG "Power"
+#define POWER_REPORT_S 3600
+
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+static volatile int64_t slept_us = 0;
+static volatile uint32_t sleeps = 0;
+static TwTimer report_timer;
+
+// Runs on the way out of light sleep with interrupts off: count only.
+static esp_err_t on_wake(int64_t sleep_time_us, void *arg) {
+    slept_us += sleep_time_us;
+    sleeps++;
+    return ESP_OK;
+}
+
+static void report(TwTimer *t, void *arg) {
+    int64_t us = slept_us;
+    uint32_t n = sleeps;
+    slept_us = 0;
+    sleeps = 0;
+    ESP_LOGI(TAG, "Ngủ nhẹ %lld/%d s (%d%%), %u lần trong giờ qua",
+             (long long)(us / 1000000), POWER_REPORT_S, (int)(us / (POWER_REPORT_S * 10000LL)), (unsigned)n);
+    tw_arm(t, POWER_REPORT_S);
+}
+#endif
+
+void power_init(void) {
+#if CONFIG_PM_ENABLE
+    esp_pm_config_t cfg = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_XTAL_FREQ,
+        .light_sleep_enable = true,
+    };
+    esp_err_t err = esp_pm_configure(&cfg);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_pm_configure lỗi: %s", esp_err_to_name(err));
+        return;
+    }
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+    esp_pm_sleep_cbs_register_config_t cbs = { .exit_cb = on_wake };
+    ESP_ERROR_CHECK(esp_pm_light_sleep_register_cbs(&cbs));
+    tw_init_timer(&report_timer, report, NULL);
+    tw_arm(&report_timer, POWER_REPORT_S);
+#endif
+    ESP_LOGI(TAG, "PM: %d-%d MHz, light sleep tự động", cfg.min_freq_mhz, cfg.max_freq_mhz);
+#else
+    ESP_LOGW(TAG, "CONFIG_PM_ENABLE tắt, không ngủ nhẹ");
+#endif
+}
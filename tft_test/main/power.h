@@ -0,0 +1,7 @@
+#pragma once
+
+// Dynamic frequency scaling plus automatic light sleep whenever every task
+// is blocked. Wake sources are the FreeRTOS tick deadline (tickless idle)
+// and the button GPIOs (see buttons_init). With
+// CONFIG_PM_LIGHT_SLEEP_CALLBACKS the time spent asleep is logged hourly.
+void power_init(void);
@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "reminders_store.h"
+#include "civil_time.h"
+#include "recur.h"
+
+static const char *const WEEKDAYS[7] = { "MO", "TU", "WE", "TH", "FR", "SA", "SU" };
+
+int32_t recur_next_day(const RecurRule *rule, int32_t anchor, int32_t from) {
+    int32_t start = (anchor > from) ? anchor : from;
+    int32_t day = -1;
+    switch (rule->kind) {
+    case RECUR_NONE:
+    case RECUR_DAILY: {
+        int32_t n = (rule->arg > 1) ? rule->arg : 1;
+        day = (anchor > 0 && n > 1) ? anchor + (start - anchor + n - 1) / n * n : start;
+        break;
+    }
+    case RECUR_WEEKLY: {
+        uint8_t mask = rule->arg & 0x7f;
+        int wd = civil_weekday(start);
+        for (int k = 0; mask && k < 7; k++) {
+            if (mask & (1u << ((wd + k) % 7))) { day = start + k; break; }
+        }
+        break;
+    }
+    case RECUR_MONTHLY: {
+        int dom = rule->arg;
+        if (dom < 1 || dom > 31) break;
+        int y, m, d;
+        civil_from_days(start, &y, &m, &d);
+        if (d > dom && ++m > 12) { m = 1; y++; }
+        // No month run longer than two lacks day 29..31.
+        for (int k = 0; k < 3; k++) {
+            if (dom <= civil_days_in_month(y, m)) { day = days_from_civil(y, m, dom); break; }
+            if (++m > 12) { m = 1; y++; }
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    if (day >= 0 && rule->until && day > rule->until) return -1;
+    return day;
+}
+
+time_t reminder_next_fire(const Reminder *r, time_t now) {
+    if (r->status == REM_STATUS_COMPLETED) return (time_t)-1;
+    int32_t today = civil_local_day(now);
+    int32_t from = (r->min_of_day >= civil_local_min_of_day(now)) ? today : today + 1;
+    int32_t day;
+    if (r->status == REM_STATUS_REPEAT) day = recur_next_day(&r->rule, r->day, from);
+    else day = (r->day != 0 && r->day >= from) ? r->day : -1;
+    if (day < 0) return (time_t)-1;
+    return civil_to_utc(day, r->min_of_day);
+}
+
+static bool parse_byday(char *v, uint8_t *mask) {
+    char *save;
+    for (char *tok = strtok_r(v, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        int k = 0;
+        while (k < 7 && strcmp(tok, WEEKDAYS[k]) != 0) k++;
+        if (k == 7) return false;
+        *mask |= (uint8_t)(1u << k);
+    }
+    return *mask != 0;
+}
+
+bool recur_parse(const char *s, RecurRule *out) {
+    RecurRule r = {0};
+    int interval = 1, mday = 0;
+    uint8_t mask = 0;
+    char buf[96];
+    if (!s) s = "";
+    if (strncmp(s, "RRULE:", 6) == 0) s += 6;
+    if (strlen(s) >= sizeof(buf)) return false;
+    strcpy(buf, s);
+    char *save;
+    for (char *tok = strtok_r(buf, ";", &save); tok; tok = strtok_r(NULL, ";", &save)) {
+        char *val = strchr(tok, '=');
+        if (!val) return false;
+        *val++ = 0;
+        if (strcmp(tok, "FREQ") == 0) {
+            if (strcmp(val, "DAILY") == 0) r.kind = RECUR_DAILY;
+            else if (strcmp(val, "WEEKLY") == 0) r.kind = RECUR_WEEKLY;
+            else if (strcmp(val, "MONTHLY") == 0) r.kind = RECUR_MONTHLY;
+            else return false;
+        } else if (strcmp(tok, "INTERVAL") == 0) {
+            interval = atoi(val);
+            if (interval < 1 || interval > 255) return false;
+        } else if (strcmp(tok, "BYDAY") == 0) {
+            if (!parse_byday(val, &mask)) return false;
+        } else if (strcmp(tok, "BYMONTHDAY") == 0) {
+            mday = atoi(val);
+            if (mday < 1 || mday > 31) return false;
+        } else if (strcmp(tok, "UNTIL") == 0) {
+            int y, m, d;
+            if (strlen(val) < 8 || sscanf(val, "%4d%2d%2d", &y, &m, &d) != 3) return false;
+            if (y < 1970 || y > 2149 || m < 1 || m > 12 || d < 1 || d > civil_days_in_month(y, m)) return false;
+            r.until = (uint16_t)days_from_civil(y, m, d);
+        } else {
+            return false;
+        }
+    }
+    switch (r.kind) {
+    case RECUR_NONE:
+        if (buf[0]) return false;
+        break;
+    case RECUR_DAILY:
+        if (mask || mday) return false;
+        r.arg = (uint8_t)interval;
+        break;
+    case RECUR_WEEKLY:
+        if (interval != 1 || !mask || mday) return false;
+        r.arg = mask;
+        break;
+    case RECUR_MONTHLY:
+        if (interval != 1 || mask || !mday) return false;
+        r.arg = (uint8_t)mday;
+        break;
+    }
+    *out = r;
+    return true;
+}
+
+void recur_format(const RecurRule *rule, char *out, size_t len) {
+    int n = 0;
+    out[0] = 0;
+    switch (rule->kind) {
+    case RECUR_DAILY:
+        n = snprintf(out, len, "FREQ=DAILY");
+        if (rule->arg > 1) n += snprintf(out + n, len - n, ";INTERVAL=%u", rule->arg);
+        break;
+    case RECUR_WEEKLY:
+        n = snprintf(out, len, "FREQ=WEEKLY;BYDAY=");
+        for (int k = 0; k < 7 && (size_t)n < len; k++) {
+            if (rule->arg & (1u << k)) n += snprintf(out + n, len - n, "%s%s", out[n - 1] == '=' ? "" : ",", WEEKDAYS[k]);
+        }
+        break;
+    case RECUR_MONTHLY:
+        n = snprintf(out, len, "FREQ=MONTHLY;BYMONTHDAY=%u", rule->arg);
+        break;
+    default:
+        return;
+    }
+    if (rule->until && (size_t)n < len) {
+        int y, m, d;
+        civil_from_days(rule->until, &y, &m, &d);
+        snprintf(out + n, len - n, ";UNTIL=%04d%02d%02d", y, m, d);
+    }
+}
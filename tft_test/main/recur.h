@@ -0,0 +1,27 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Only consulted for REM_STATUS_REPEAT reminders; Reminder.day is the first
+// possible occurrence (0 = none) and the base for DAILY intervals.
+typedef enum {
+    RECUR_NONE = 0,   // plain "repeat": every day
+    RECUR_DAILY,      // every arg days (0 or 1 = every day)
+    RECUR_WEEKLY,     // arg = weekday mask, bit 0 = Monday
+    RECUR_MONTHLY,    // arg = day of month; months without it are skipped
+} RecurKind;
+
+typedef struct {
+    uint8_t  kind;
+    uint8_t  arg;
+    uint16_t until;   // last day an occurrence may fall on, 0 = open-ended
+} RecurRule;
+
+// First day >= from (days since 1970-01-01) the rule fires on, or -1.
+int32_t recur_next_day(const RecurRule *rule, int32_t anchor, int32_t from);
+
+// RRULE subset: FREQ=DAILY|WEEKLY|MONTHLY, INTERVAL (daily only), BYDAY,
+// BYMONTHDAY, UNTIL=YYYYMMDD. An empty string parses to RECUR_NONE.
+bool recur_parse(const char *s, RecurRule *out);
+void recur_format(const RecurRule *rule, char *out, size_t len);
@@ -1,5 +1,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
 #include <stdlib.h>
 #include <stdbool.h>
 #include "esp_err.h"
@@ -7,10 +9,28 @@
 #include "cJSON.h"
 #include "nvs.h"         
 #include "nvs_flash.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
 #include "mqtt.h"
+#include "due_index.h"
+#include "journal.h"
+#include "recur.h"
+#include "scheduler.h"
+#include "time_utils.h"
+#include "vclock.h"
 #define MAX_REMINDERS 16
 #define TAG "Reminders task"
 
+const char* CONTENT_PRESETS[] = {
+    "BAO THUC", "HOP SANG", "HOP CHIEU", "TAP THE DUC",
+    "UONG THUOC", "NHAC HANH LY", "GOI DIEN", "KHOI HANH",
+    "DI CHO", "DON TRE", "NHAC LAM VIEC", "NHAC SINH NHAT"
+};
+
+const int NUM_CONTENT_PRESETS = (int)(sizeof(CONTENT_PRESETS)/sizeof(CONTENT_PRESETS[0]));
+
+static const char *STATUS_STR[] = { "pending", "completed", "repeat" };
+
 int next_id = 1;
 int num_reminders = 0;
 int pick_index = 0;
@@ -18,6 +38,88 @@ int pick_index = 0;
 SemaphoreHandle_t reminders_mutex = NULL;
 Reminder reminders[MAX_REMINDERS] = {};
 
+// Interned non-preset contents, NUL-separated; guarded by reminders_mutex.
+static char content_pool[CONTENT_POOL_SIZE];
+static int  pool_used = 0;
+
+// Pre-compact layout, still found in NVS on devices that have not re-saved.
+typedef struct {
+    int  id;
+    char date[11];
+    int  hour;
+    int  minute;
+    char content[64];
+    char status[16];
+} LegacyReminder;
+
+// Schema 2-3 record, before recurrence rules.
+typedef struct {
+    uint16_t id;
+    uint16_t day;
+    uint16_t min_of_day;
+    uint8_t  status : 2;
+    uint8_t  pooled : 1;
+    uint8_t  flags  : 5;
+    uint8_t  content;
+} ReminderV3;
+
+_Static_assert(sizeof(Reminder) == 12, "Reminder record layout is persisted in NVS");
+_Static_assert(sizeof(ReminderV3) == 8, "ReminderV3 record layout is persisted in NVS");
+
+// Written last on every save; crc covers the records and pool it describes,
+// so a save interrupted between blob writes is detected on the next load.
+typedef struct {
+    uint32_t gen;
+    uint32_t crc;
+    uint16_t next_id;
+    uint16_t pool_len;
+    uint8_t  count;
+    uint8_t  reserved[3];
+} StoreHeader;
+
+_Static_assert(MAX_REMINDERS <= 32, "dirty mask is a uint32_t");
+
+// Layout of the "reminders" NVS namespace; stored under the "schema" key.
+#define STORE_SCHEMA_VERSION 4
+static uint8_t stored_schema = 0;
+
+// Mirror of what is currently in NVS; slots that differ from it are dirty.
+static Reminder persisted[MAX_REMINDERS];
+static int      persisted_count = 0;
+static int      persisted_next_id = 0;
+static char     persisted_pool[CONTENT_POOL_SIZE];
+static int      persisted_pool_used = 0;
+static bool     persisted_valid = false;
+static uint32_t store_gen = 0;
+
+// Copy of the table taken under reminders_mutex; NVS is written from this
+// so the flash erase/write never runs with the table locked.
+static Reminder snap[MAX_REMINDERS];
+static int      snap_count = 0;
+static int      snap_next_id = 1;
+static char     snap_pool[CONTENT_POOL_SIZE];
+static int      snap_pool_used = 0;
+
+#define PERSIST_DIRTY  (1u << 0)
+#define PERSIST_FLUSH  (1u << 1)
+
+static TaskHandle_t      persist_task_handle = NULL;
+static SemaphoreHandle_t persist_mutex = NULL;
+
+// History messages waiting to be appended to the journal by the persist task.
+#define HISTORY_QUEUE_LEN 8
+static QueueHandle_t history_queue = NULL;
+
+static time_t store_now(void) { return vclock_now(); }
+
+// Two published copies: the writer (holding reminders_mutex) fills the one
+// not being served, then flips pub_front. A reader copies the front buffer
+// and retries if that buffer's sequence moved while it was copying.
+static ReminderSnapshot pub_buf[2];
+static uint32_t pub_seq[2];
+static int      pub_front = 0;
+static uint32_t pub_version = 0;
+
 void recompute_next_id_locked(void) {
     int maxid = 0;
     for (int i = 0; i < num_reminders; i++) {
@@ -26,226 +128,535 @@ void recompute_next_id_locked(void) {
     next_id = (maxid > 0) ? (maxid + 1) : 1;
 }
 
+int reminder_index_by_id_locked(int id) {
+    for (int i = 0; i < num_reminders; i++) {
+        if (reminders[i].id == id) return i;
+    }
+    return -1;
+}
+
+const char *reminder_status_str(ReminderStatus status) {
+    if ((unsigned)status >= sizeof(STATUS_STR)/sizeof(STATUS_STR[0])) return "";
+    return STATUS_STR[status];
+}
+
+int reminder_status_from_str(const char *s) {
+    if (!s) return -1;
+    for (int i = 0; i < (int)(sizeof(STATUS_STR)/sizeof(STATUS_STR[0])); i++) {
+        if (strcmp(s, STATUS_STR[i]) == 0) return i;
+    }
+    return -1;
+}
+
+// Pointer into the pool is only stable while reminders_mutex is held.
+static const char *content_at(const Reminder *r, const char *pool, int pool_len) {
+    if (r->pooled) return (r->content < pool_len) ? &pool[r->content] : "";
+    return (r->content < NUM_CONTENT_PRESETS) ? CONTENT_PRESETS[r->content] : "";
+}
+
+const char *reminder_content(const Reminder *r) {
+    return content_at(r, content_pool, pool_used);
+}
+
+void reminder_date_str(const Reminder *r, char out[11]) {
+    if (r->day == 0) { out[0] = 0; return; }
+    int y, m, d;
+    civil_from_days(r->day, &y, &m, &d);
+    fmt_date(y, m, d, out);
+}
+
+static bool date_to_day(const char *date, uint16_t *out) {
+    int y, m, d;
+    if (!parse_date_checked(date, &y, &m, &d)) return false;
+    *out = (uint16_t)days_from_civil(y, m, d);
+    return true;
+}
+
+static int pool_find(const char *buf, int used, const char *s) {
+    for (int off = 0; off < used; off += (int)strlen(&buf[off]) + 1) {
+        if (strcmp(&buf[off], s) == 0) return off;
+    }
+    return -1;
+}
+
+static void pool_compact_locked(void) {
+    char tmp[CONTENT_POOL_SIZE];
+    int used = 0;
+    for (int i = 0; i < num_reminders; i++) {
+        Reminder *r = &reminders[i];
+        if (!r->pooled) continue;
+        const char *s = reminder_content(r);
+        int off = pool_find(tmp, used, s);
+        if (off < 0) {
+            int n = (int)strlen(s) + 1;
+            memcpy(&tmp[used], s, n);
+            off = used;
+            used += n;
+        }
+        r->content = (uint8_t)off;
+    }
+    memcpy(content_pool, tmp, used);
+    pool_used = used;
+}
+
+bool reminder_set_content_locked(Reminder *r, const char *content) {
+    for (int p = 0; p < NUM_CONTENT_PRESETS; p++) {
+        if (strcmp(content, CONTENT_PRESETS[p]) == 0) {
+            r->pooled = 0; r->content = (uint8_t)p;
+            return true;
+        }
+    }
+    char s[CONTENT_LENGTH];
+    strncpy(s, content, sizeof(s) - 1);
+    s[sizeof(s) - 1] = 0;
+    int n = (int)strlen(s) + 1;
+    int off = pool_find(content_pool, pool_used, s);
+    if (off < 0) {
+        if (pool_used + n > CONTENT_POOL_SIZE) pool_compact_locked();
+        if (pool_used + n > CONTENT_POOL_SIZE) {
+            ESP_LOGE(TAG, "Bộ nhớ nội dung đã đầy: %s", s);
+            return false;
+        }
+        memcpy(&content_pool[pool_used], s, n);
+        off = pool_used;
+        pool_used += n;
+    }
+    r->pooled = 1; r->content = (uint8_t)off;
+    return true;
+}
+
+static bool reminder_pack_locked(Reminder *r, int id, const char *date, int hour, int min, const char *content, ReminderStatus status) {
+    Reminder rec = {0};
+    rec.id = (uint16_t)id;
+    if (date && date[0] && !date_to_day(date, &rec.day)) {
+        ESP_LOGW(TAG, "Ngày không hợp lệ cho ID %d: %s", id, date);
+    }
+    reminder_set_time(&rec, hour, min);
+    rec.status = status;
+    if (!reminder_set_content_locked(&rec, content ? content : "")) return false;
+    *r = rec;
+    return true;
+}
+
+static void reminder_from_legacy_locked(Reminder *r, const LegacyReminder *old) {
+    LegacyReminder tmp = *old;
+    tmp.date[sizeof(tmp.date) - 1] = 0;
+    tmp.content[sizeof(tmp.content) - 1] = 0;
+    tmp.status[sizeof(tmp.status) - 1] = 0;
+    int st = reminder_status_from_str(tmp.status);
+    if (st < 0) st = REM_STATUS_PENDING;
+    if (!reminder_pack_locked(r, tmp.id, tmp.date, tmp.hour, tmp.minute, tmp.content, st)) {
+        memset(r, 0, sizeof(*r));
+        r->id = (uint16_t)tmp.id;
+        reminder_set_time(r, tmp.hour, tmp.minute);
+    }
+}
+
 void reminders_recalc(void) {
     if (!reminders_mutex) return;
     xSemaphoreTake(reminders_mutex, portMAX_DELAY);
     int count = 0;
     int maxid = 0;
     for (int i = 0; i < MAX_REMINDERS; i++) {
-        if (reminders[i].id > 0 ||
-            reminders[i].content[0] != '\0' ||
-            reminders[i].date[0]    != '\0') {
+        if (reminders[i].id > 0 || reminders[i].day != 0) {
             count++;
             if (reminders[i].id > maxid) maxid = reminders[i].id;
         }
     }
     num_reminders = count;
     next_id       = (maxid > 0) ? (maxid + 1) : 1;
+    due_index_invalidate();
+    reminders_publish_locked();
     xSemaphoreGive(reminders_mutex);
 }
 
-void add_reminder_full(int id, const char *date, int hour, int min, const char *content, const char *status) {
-    xSemaphoreTake(reminders_mutex, pdMS_TO_TICKS(1000));
-    if (num_reminders < MAX_REMINDERS) {
-        int idx = num_reminders;
-        reminders[idx].id = id;
-        strncpy(reminders[idx].date, date, sizeof(reminders[idx].date) - 1);
-        reminders[idx].date[sizeof(reminders[idx].date) - 1] = 0;
-        reminders[idx].hour = hour;
-        reminders[idx].minute = min;
-        strncpy(reminders[idx].content, content, sizeof(reminders[idx].content) - 1);
-        reminders[idx].content[sizeof(reminders[idx].content) - 1] = 0;
-        strncpy(reminders[idx].status, status, sizeof(reminders[idx].status) - 1);
-        reminders[idx].status[sizeof(reminders[idx].status) - 1] = 0;
-        num_reminders++;
-        recompute_next_id_locked();
-        ESP_LOGI(TAG, "Thêm báo thức ID %d: %s %02d:%02d %s %s", 
-                 id, date, hour, min, content, status);
-        cJSON *add_json = cJSON_CreateObject();
-        cJSON_AddNumberToObject(add_json, "id", id);
-        cJSON_AddStringToObject(add_json, "date", date);
-        char time_str[6];
-        snprintf(time_str, sizeof(time_str), "%02d:%02d", hour, min);
-        cJSON_AddStringToObject(add_json, "time", time_str);
-        cJSON_AddStringToObject(add_json, "content", content);
-        cJSON_AddStringToObject(add_json, "status", status);
-        char *add_str = cJSON_PrintUnformatted(add_json);
-        mqtt_publish("reminders/add", add_str, 0, 0);
-        cJSON_Delete(add_json);
-        free(add_str);
-    } else {
-        ESP_LOGE(TAG, "Danh sách báo thức đã đầy");
-    }
-    xSemaphoreGive(reminders_mutex);
-}
+typedef struct {
+    Reminder rec;
+    char     date[11];
+    char     content[CONTENT_LENGTH];
+} StoreEvent;
 
-void add_reminder_full_nr(int id, const char *date, int hour, int min, const char *content, const char *status) {
-    xSemaphoreTake(reminders_mutex, pdMS_TO_TICKS(1000));
-    if (num_reminders < MAX_REMINDERS) {
-        int idx = num_reminders;
-        reminders[idx].id = id;
-        strncpy(reminders[idx].date, date, sizeof(reminders[idx].date) - 1);
-        reminders[idx].date[sizeof(reminders[idx].date) - 1] = 0;
-        reminders[idx].hour = hour;
-        reminders[idx].minute = min;
-        strncpy(reminders[idx].content, content, sizeof(reminders[idx].content) - 1);
-        reminders[idx].content[sizeof(reminders[idx].content) - 1] = 0;
-        strncpy(reminders[idx].status, status, sizeof(reminders[idx].status) - 1);
-        reminders[idx].status[sizeof(reminders[idx].status) - 1] = 0;
-        num_reminders++;
-        recompute_next_id_locked();
-        ESP_LOGI(TAG, "Thêm báo thức ID %d: %s %02d:%02d %s %s", 
-                 id, date, hour, min, content, status);
-       
-    } else {
-        ESP_LOGE(TAG, "Danh sách báo thức đã đầy");
-    }
-    xSemaphoreGive(reminders_mutex);
-}
+static QueueHandle_t store_queue = NULL;
+static bool txn_active = false;   // owner is inside a batch; defer index/publish
 
-void update_reminder(int id, const char *date, int hour, int min, const char *content, const char *status) {
-    ESP_LOGI(TAG, "Bắt đầu update_reminder, id=%d", id);
-    if (!reminders_mutex) {
-        ESP_LOGE(TAG, "reminders_mutex chưa khởi tạo");
-        return;
-    }
-    if (xSemaphoreTake(reminders_mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-        int i;
-        for (i = 0; i < num_reminders; i++) {
-            if (reminders[i].id == id) {
-                ESP_LOGI(TAG, "Tìm thấy báo thức ID %d", id);
-                if (date && strlen(date) > 0) {
-                    strncpy(reminders[i].date, date, sizeof(reminders[i].date) - 1);
-                    reminders[i].date[sizeof(reminders[i].date) - 1] = 0;
-                }
-                if (hour >= 0 && min >= 0) {
-                    reminders[i].hour = hour;
-                    reminders[i].minute = min;
-                }
-                if (content && strlen(content) > 0) {
-                    strncpy(reminders[i].content, content, sizeof(reminders[i].content) - 1);
-                    reminders[i].content[sizeof(reminders[i].content) - 1] = 0;
-                }
-                if (status && strlen(status) > 0) {
-                    strncpy(reminders[i].status, status, sizeof(reminders[i].status) - 1);
-                    reminders[i].status[sizeof(reminders[i].status) - 1] = 0;
-                }
-                ESP_LOGI(TAG, "Cập nhật báo thức ID %d: %s %02d:%02d %s %s", 
-                         id, date ? date : reminders[i].date, hour, min, 
-                         content ? content : reminders[i].content, status ? status : reminders[i].status);
-                cJSON *update_json = cJSON_CreateObject();
-                if (!update_json) {
-                    ESP_LOGE(TAG, "Không thể tạo JSON object");
-                    xSemaphoreGive(reminders_mutex);
-                    return;
-                }
-                cJSON_AddNumberToObject(update_json, "id", id);
-                if (date && strlen(date) > 0) cJSON_AddStringToObject(update_json, "date", date);
-                
-                char time_str[6];
-                snprintf(time_str, sizeof(time_str), "%02d:%02d", hour, min);
-                cJSON_AddStringToObject(update_json, "time", time_str);
-                
-                if (content && strlen(content) > 0) cJSON_AddStringToObject(update_json, "content", content);
-                if (status && strlen(status) > 0) cJSON_AddStringToObject(update_json, "status", status);
-                char *update_str = cJSON_PrintUnformatted(update_json);
-                if (update_str) {
-                    mqtt_publish("reminders/update", update_str, 0, 0);
-                    free(update_str);
-                } else {
-                    ESP_LOGE(TAG, "Không thể tạo JSON string");
-                }
-                cJSON_Delete(update_json);
-                break;
-            }
+// Applies one command to the table. Runs with reminders_mutex held and does
+// no I/O; the caller publishes and persists from *ev after releasing it.
+static esp_err_t store_apply_locked(const StoreCmd *c, StoreEvent *ev) {
+    int id = c->id;
+    int i = reminder_index_by_id_locked(id);
+    switch (c->type) {
+    case STORE_CMD_ADD: {
+        if (id == -1) { id = next_id; i = -1; }
+        if (i >= 0) {
+            ESP_LOGE(TAG, "Báo thức ID %d đã tồn tại", id);
+            return ESP_ERR_INVALID_STATE;
         }
-        if (i == num_reminders) {
+        if (num_reminders >= MAX_REMINDERS) {
+            ESP_LOGE(TAG, "Danh sách báo thức đã đầy");
+            return ESP_ERR_NO_MEM;
+        }
+        Reminder rec = {0};
+        rec.id = (uint16_t)id;
+        rec.day = c->day;
+        rec.min_of_day = c->min_of_day;
+        rec.status = c->status;
+        rec.rule = c->rule;
+        if (!reminder_set_content_locked(&rec, c->content)) return ESP_ERR_NO_MEM;
+        i = num_reminders++;
+        reminders[i] = rec;
+        recompute_next_id_locked();
+        break;
+    }
+    case STORE_CMD_UPDATE: {
+        if (i < 0) {
             ESP_LOGE(TAG, "Không tìm thấy báo thức ID %d", id);
+            return ESP_ERR_NOT_FOUND;
         }
-        xSemaphoreGive(reminders_mutex);
-    } else {
-        ESP_LOGE(TAG, "Không thể lấy reminders_mutex");
+        // Intern the content first so a full pool leaves the record as it was.
+        Reminder rec = reminders[i];
+        if ((c->fields & STORE_F_CONTENT) && !reminder_set_content_locked(&rec, c->content)) return ESP_ERR_NO_MEM;
+        if (c->fields & STORE_F_DAY) rec.day = c->day;
+        if (c->fields & STORE_F_TIME) rec.min_of_day = c->min_of_day;
+        if (c->fields & STORE_F_STATUS) rec.status = c->status;
+        if (c->fields & STORE_F_RULE) rec.rule = c->rule;
+        reminders[i] = rec;
+        break;
     }
-}
-
-void delete_reminder_at(int idx) {
-    xSemaphoreTake(reminders_mutex, pdMS_TO_TICKS(1000));
-    if (idx >= 0 && idx < num_reminders) {
-        int id = reminders[idx].id; 
-        for (int i = idx; i < num_reminders - 1; i++) {
-            reminders[i] = reminders[i + 1];
+    case STORE_CMD_DELETE:
+        if (i < 0) {
+            ESP_LOGE(TAG, "Không tìm thấy báo thức với ID: %d", id);
+            return ESP_ERR_NOT_FOUND;
         }
+        for (; i < num_reminders - 1; i++) reminders[i] = reminders[i + 1];
         memset(&reminders[num_reminders - 1], 0, sizeof(Reminder));
         num_reminders--;
         if (pick_index >= num_reminders) {
             pick_index = (num_reminders > 0 ? num_reminders - 1 : 0);
         }
         recompute_next_id_locked();
+        if (!txn_active) {
+            due_index_remove_locked(id);
+            reminders_publish_locked();
+        }
+        memset(ev, 0, sizeof(*ev));
+        ev->rec.id = (uint16_t)id;
         ESP_LOGI(TAG, "Xóa báo thức ID %d", id);
-        cJSON *delete_json = cJSON_CreateObject();
-        cJSON_AddNumberToObject(delete_json, "id", id);
-        char *delete_str = cJSON_PrintUnformatted(delete_json);
-        mqtt_publish("reminders/delete", delete_str, 0, 0);
-        cJSON_Delete(delete_json);
-        free(delete_str);
+        return ESP_OK;
+    default:
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!txn_active) {
+        due_index_upsert_locked(id, store_now());
+        reminders_publish_locked();
+    }
+    ev->rec = reminders[i];
+    reminder_date_str(&reminders[i], ev->date);
+    strncpy(ev->content, reminder_content(&reminders[i]), CONTENT_LENGTH - 1);
+    ev->content[CONTENT_LENGTH - 1] = 0;
+    ESP_LOGI(TAG, "%s báo thức ID %d: %s %02d:%02d %s %s",
+             c->type == STORE_CMD_ADD ? "Thêm" : "Cập nhật", id, ev->date,
+             reminder_hour(&ev->rec), reminder_min(&ev->rec), ev->content,
+             reminder_status_str(ev->rec.status));
+    return ESP_OK;
+}
+
+static const char *store_event_fill(cJSON *json, const StoreCmd *c, const StoreEvent *ev) {
+    cJSON_AddNumberToObject(json, "id", ev->rec.id);
+    if (c->type == STORE_CMD_DELETE) return "delete";
+    if (c->type == STORE_CMD_UPDATE && c->fields == STORE_F_STATUS) {
+        cJSON_AddStringToObject(json, "status", reminder_status_str(ev->rec.status));
+        return "status";
+    }
+    char time_str[6];
+    fmt_time(reminder_hour(&ev->rec), reminder_min(&ev->rec), time_str);
+    cJSON_AddStringToObject(json, "date", ev->date);
+    cJSON_AddStringToObject(json, "time", time_str);
+    cJSON_AddStringToObject(json, "content", ev->content);
+    cJSON_AddStringToObject(json, "status", reminder_status_str(ev->rec.status));
+    if (ev->rec.rule.kind != RECUR_NONE) {
+        char rule[64];
+        recur_format(&ev->rec.rule, rule, sizeof(rule));
+        cJSON_AddStringToObject(json, "rule", rule);
+    }
+    return (c->type == STORE_CMD_ADD) ? "add" : "update";
+}
+
+static void store_publish_json(const char *topic, cJSON *json) {
+    char *str = cJSON_PrintUnformatted(json);
+    if (str) {
+        mqtt_publish(topic, str, 0, 0);
+        free(str);
     } else {
-        ESP_LOGE(TAG, "Index không hợp lệ: %d", idx);
+        ESP_LOGE(TAG, "Không thể tạo JSON string");
     }
-    xSemaphoreGive(reminders_mutex);
+    cJSON_Delete(json);
 }
 
-void delete_reminder_at_nr(int id) {
-    xSemaphoreTake(reminders_mutex, pdMS_TO_TICKS(1000));
-    int idx = -1;
-    for (int i = 0; i < num_reminders; i++) {
-        if (reminders[i].id == id) {
-            idx = i;
-            break;
-        }
+static void store_publish_event(const StoreCmd *c, const StoreEvent *ev) {
+    cJSON *json = cJSON_CreateObject();
+    if (!json) {
+        ESP_LOGE(TAG, "Không thể tạo JSON object");
+        return;
     }
-    if (idx >= 0 && idx < num_reminders) {
-        for (int i = idx; i < num_reminders - 1; i++) {
-            reminders[i] = reminders[i + 1];
-        }
-        memset(&reminders[num_reminders - 1], 0, sizeof(Reminder));
-        num_reminders--;
-        if (pick_index >= num_reminders) {
-            pick_index = (num_reminders > 0 ? num_reminders - 1 : 0);
+    char topic[24];
+    snprintf(topic, sizeof(topic), "reminders/%s", store_event_fill(json, c, ev));
+    store_publish_json(topic, json);
+}
+
+static esp_err_t store_execute_txn(const StoreCmd *c) {
+    static StoreEvent evs[STORE_TXN_MAX_OPS];
+    static Reminder   saved[MAX_REMINDERS];
+    static char       saved_pool[CONTENT_POOL_SIZE];
+    const ReminderTxn *t = c->txn;
+    esp_err_t err = ESP_OK;
+    int k = 0;
+    xSemaphoreTake(reminders_mutex, portMAX_DELAY);
+    memcpy(saved, reminders, sizeof(saved));
+    memcpy(saved_pool, content_pool, pool_used);
+    int saved_n = num_reminders, saved_next = next_id, saved_used = pool_used, saved_pick = pick_index;
+    txn_active = true;
+    for (; k < t->n && err == ESP_OK; k++) err = store_apply_locked(&t->ops[k], &evs[k]);
+    txn_active = false;
+    if (err != ESP_OK) {
+        memcpy(reminders, saved, sizeof(saved));
+        memcpy(content_pool, saved_pool, saved_used);
+        num_reminders = saved_n; next_id = saved_next; pool_used = saved_used; pick_index = saved_pick;
+        ESP_LOGE(TAG, "Giao dịch bị hủy tại lệnh %d/%d: %s", k, t->n, esp_err_to_name(err));
+    }
+    due_index_invalidate();
+    reminders_publish_locked();
+    xSemaphoreGive(reminders_mutex);
+    if (err != ESP_OK) return err;
+    ESP_LOGI(TAG, "Áp dụng giao dịch %d lệnh", t->n);
+    if (c->publish) {
+        cJSON *json = cJSON_CreateObject();
+        cJSON *arr = json ? cJSON_AddArrayToObject(json, "ops") : NULL;
+        for (int i = 0; arr && i < t->n; i++) {
+            cJSON *item = cJSON_CreateObject();
+            if (!item) break;
+            cJSON_AddStringToObject(item, "action", store_event_fill(item, &t->ops[i], &evs[i]));
+            cJSON_AddItemToArray(arr, item);
         }
-        recompute_next_id_locked();
-        ESP_LOGI(TAG, "Xóa báo thức ID %d tại chỉ số %d", id, idx);
-        
-    } else {
-        ESP_LOGE(TAG, "Không tìm thấy báo thức với ID: %d", id);
+        if (json) store_publish_json("reminders/batch", json);
     }
+    if (c->urgent) reminders_persist_flush();
+    else reminders_persist_request();
+    return ESP_OK;
+}
+
+static esp_err_t store_execute(const StoreCmd *c) {
+    if (c->type == STORE_CMD_TXN) return store_execute_txn(c);
+    StoreEvent ev;
+    xSemaphoreTake(reminders_mutex, portMAX_DELAY);
+    esp_err_t err = store_apply_locked(c, &ev);
     xSemaphoreGive(reminders_mutex);
+    if (err != ESP_OK) return err;
+    if (c->publish) store_publish_event(c, &ev);
+    if (c->urgent) reminders_persist_flush();
+    else reminders_persist_request();
+    if (c->token) c->token->id = ev.rec.id;
+    return ESP_OK;
+}
+
+static void store_task(void *arg) {
+    StoreCmd cmd;
+    while (1) {
+        if (xQueueReceive(store_queue, &cmd, portMAX_DELAY) != pdTRUE) continue;
+        esp_err_t err = store_execute(&cmd);
+        if (cmd.type == STORE_CMD_TXN && cmd.txn_owned) free((void *)cmd.txn);
+        if (cmd.token) {
+            cmd.token->result = err;
+            xSemaphoreGive(cmd.token->done);
+        }
+    }
+}
+
+void reminders_store_start(void) {
+    if (store_queue) return;
+    if (!reminders_mutex) reminders_mutex = xSemaphoreCreateMutex();
+    store_queue = xQueueCreate(8, sizeof(StoreCmd));
+    xTaskCreatePinnedToCore(store_task, "store", 4096, NULL, 4, NULL, 0);
+}
+
+void store_token_init(StoreToken *tok) {
+    tok->done = xSemaphoreCreateBinaryStatic(&tok->buf);
+    tok->result = ESP_ERR_TIMEOUT;
+    tok->id = -1;
+}
+
+esp_err_t store_token_wait(StoreToken *tok, TickType_t ticks) {
+    if (xSemaphoreTake(tok->done, ticks) != pdTRUE) return ESP_ERR_TIMEOUT;
+    return tok->result;
+}
+
+static esp_err_t store_cmd_validate(const StoreCmd *cmd) {
+    if (cmd->type == STORE_CMD_TXN) return cmd->txn ? ESP_OK : ESP_ERR_INVALID_ARG;
+    if (cmd->type != STORE_CMD_DELETE && (unsigned)cmd->status > REM_STATUS_REPEAT) {
+        ESP_LOGE(TAG, "Trạng thái không hợp lệ: %d", (int)cmd->status);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (cmd->min_of_day >= 24 * 60) {
+        ESP_LOGE(TAG, "Giờ không hợp lệ: %u", cmd->min_of_day);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (cmd->rule.kind > RECUR_MONTHLY) {
+        ESP_LOGE(TAG, "Quy tắc lặp không hợp lệ: %u", cmd->rule.kind);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (cmd->type != STORE_CMD_ADD && cmd->id < 0) return ESP_ERR_INVALID_ARG;
+    return ESP_OK;
+}
+
+esp_err_t store_submit(StoreCmd *cmd, StoreToken *tok) {
+    esp_err_t verr = store_cmd_validate(cmd);
+    if (verr != ESP_OK) return verr;
+    cmd->content[CONTENT_LENGTH - 1] = 0;
+    cmd->token = tok;
+    if (!store_queue) {
+        // Before the owner task starts (boot), apply on the caller's stack.
+        esp_err_t err = store_execute(cmd);
+        if (tok) { tok->result = err; xSemaphoreGive(tok->done); }
+        return err;
+    }
+    if (xQueueSend(store_queue, cmd, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        ESP_LOGE(TAG, "Hàng đợi store đầy, bỏ lệnh %d cho ID %d", cmd->type, cmd->id);
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+static void store_cmd_init(StoreCmd *c, StoreCmdType type, int id, bool publish) {
+    memset(c, 0, sizeof(*c));
+    c->type = type;
+    c->id = id;
+    c->publish = publish;
+}
+
+void reminders_txn_begin(ReminderTxn *txn) {
+    txn->n = 0;
+}
+
+esp_err_t reminders_txn_apply(ReminderTxn *txn, const StoreCmd *cmd) {
+    if (cmd->type == STORE_CMD_TXN) return ESP_ERR_INVALID_ARG;
+    if (txn->n >= STORE_TXN_MAX_OPS) {
+        ESP_LOGE(TAG, "Giao dịch vượt quá %d lệnh", STORE_TXN_MAX_OPS);
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = store_cmd_validate(cmd);
+    if (err != ESP_OK) return err;
+    StoreCmd *op = &txn->ops[txn->n++];
+    *op = *cmd;
+    op->content[CONTENT_LENGTH - 1] = 0;
+    op->token = NULL;
+    return ESP_OK;
 }
 
-void update_reminder_status(int id, const char *status) {
-    if (!status || (strcmp(status, "pending") != 0 && strcmp(status, "completed") != 0 && strcmp(status, "repeat") != 0)) {
-        ESP_LOGE(TAG, "Trạng thái không hợp lệ: %s", status ? status : "NULL");
+esp_err_t reminders_txn_commit(ReminderTxn *txn, bool publish) {
+    if (txn->n == 0) return ESP_OK;
+    StoreCmd c;
+    StoreToken tok;
+    store_cmd_init(&c, STORE_CMD_TXN, 0, publish);
+    c.txn = txn;
+    store_token_init(&tok);
+    esp_err_t err = store_submit(&c, &tok);
+    if (err != ESP_OK) return err;
+    // The store task reads *txn until it signals; no timeout.
+    return store_token_wait(&tok, portMAX_DELAY);
+}
+
+esp_err_t reminders_txn_submit(ReminderTxn *txn, bool publish) {
+    if (txn->n == 0) {
+        free(txn);
+        return ESP_OK;
+    }
+    StoreCmd c;
+    store_cmd_init(&c, STORE_CMD_TXN, 0, publish);
+    c.txn = txn;
+    c.txn_owned = true;
+    esp_err_t err = store_submit(&c, NULL);
+    // Applied inline before the store task starts; it is not queued.
+    if (err != ESP_OK || !store_queue) free(txn);
+    return err;
+}
+
+static void store_cmd_add(int id, const char *date, int hour, int min, const char *content, ReminderStatus status, bool publish) {
+    StoreCmd c;
+    store_cmd_init(&c, STORE_CMD_ADD, id, publish);
+    if (date && date[0] && !date_to_day(date, &c.day)) {
+        ESP_LOGW(TAG, "Ngày không hợp lệ cho ID %d: %s", id, date);
+    }
+    c.min_of_day = (uint16_t)(hour * 60 + min);
+    c.status = status;
+    strncpy(c.content, content ? content : "", CONTENT_LENGTH - 1);
+    store_submit(&c, NULL);
+}
+
+void add_reminder_full(int id, const char *date, int hour, int min, const char *content, ReminderStatus status) {
+    store_cmd_add(id, date, hour, min, content, status, true);
+}
+
+void add_reminder_full_nr(int id, const char *date, int hour, int min, const char *content, ReminderStatus status) {
+    store_cmd_add(id, date, hour, min, content, status, false);
+}
+
+void update_reminder(int id, const char *date, int hour, int min, const char *content, ReminderStatus status) {
+    StoreCmd c;
+    store_cmd_init(&c, STORE_CMD_UPDATE, id, true);
+    if (date && strlen(date) > 0 && date_to_day(date, &c.day)) c.fields |= STORE_F_DAY;
+    if (hour >= 0 && min >= 0) {
+        c.min_of_day = (uint16_t)(hour * 60 + min);
+        c.fields |= STORE_F_TIME;
+    }
+    if (content && strlen(content) > 0) {
+        strncpy(c.content, content, CONTENT_LENGTH - 1);
+        c.fields |= STORE_F_CONTENT;
+    }
+    c.status = status;
+    c.fields |= STORE_F_STATUS;
+    store_submit(&c, NULL);
+}
+
+// Waits for the owner task so callers can redraw from the new table.
+void delete_reminder_at(int idx) {
+    int id = -1;
+    xSemaphoreTake(reminders_mutex, portMAX_DELAY);
+    if (idx >= 0 && idx < num_reminders) id = reminders[idx].id;
+    xSemaphoreGive(reminders_mutex);
+    if (id < 0) {
+        ESP_LOGE(TAG, "Index không hợp lệ: %d", idx);
         return;
     }
-    for (int i = 0; i < num_reminders; i++) {
-        if (reminders[i].id == id) {
-            // strncpy(reminders[i].status, status, STATUS_LENGTH);
-            strncpy(reminders[i].status, status, sizeof(reminders[i].status)-1); 
-            reminders[i].status[sizeof(reminders[i].status)-1] = 0;
-            ESP_LOGI(TAG, "Cập nhật trạng thái báo thức ID %d: %s", id, status);
-                
-            cJSON *status_json = cJSON_CreateObject();
-            cJSON_AddNumberToObject(status_json, "id", id);
-            cJSON_AddStringToObject(status_json, "status", status);
-            char *status_str = cJSON_PrintUnformatted(status_json);
-            mqtt_publish("reminders/status", status_str, 0, 0);
-            cJSON_Delete(status_json);
-            free(status_str);
-            break;
-        }
-    }   
+    StoreCmd c;
+    StoreToken tok;
+    store_cmd_init(&c, STORE_CMD_DELETE, id, true);
+    store_token_init(&tok);
+    // tok lives on this stack until the store task signals; no timeout.
+    if (store_submit(&c, &tok) == ESP_OK) store_token_wait(&tok, portMAX_DELAY);
+}
+
+void delete_reminder_at_nr(int id) {
+    StoreCmd c;
+    store_cmd_init(&c, STORE_CMD_DELETE, id, false);
+    store_submit(&c, NULL);
+}
+
+// Alarm outcomes: persisted without the write-behind window.
+void update_reminder_status(int id, ReminderStatus status) {
+    StoreCmd c;
+    store_cmd_init(&c, STORE_CMD_UPDATE, id, true);
+    c.fields = STORE_F_STATUS;
+    c.status = status;
+    c.urgent = true;
+    store_submit(&c, NULL);
 }
 
 void send_reminder_history(const char *content) {
+    if (history_queue) {
+        char msg[CONTENT_LENGTH];
+        strncpy(msg, content, sizeof(msg) - 1);
+        msg[sizeof(msg) - 1] = 0;
+        if (xQueueSend(history_queue, msg, 0) == pdTRUE) reminders_persist_request();
+    }
     cJSON *history_json = cJSON_CreateObject();
     cJSON_AddStringToObject(history_json, "message", content);
     char *history_str = cJSON_PrintUnformatted(history_json);
@@ -255,73 +666,167 @@ void send_reminder_history(const char *content) {
     
 }
 
-void sync_reminder(const char *action, int id, const char *date, const char *time, const char *content, const char *status) {
-        if (strcmp(action, "add") == 0) {
+// Turns one MQTT sync request into a store command (publish off: the
+// change came from the app). Invalid update fields are skipped, not fatal.
+static esp_err_t sync_build_cmd(StoreCmd *c, const char *action, int id, const char *date, const char *time, const char *content, const char *status, const char *rule) {
+    if (strcmp(action, "add") == 0) {
         if (!date || !time || !content || !status) {
             ESP_LOGE(TAG, "Thiếu trường bắt buộc cho action add");
-            return;
+            return ESP_ERR_INVALID_ARG;
         }
         int hour, min;
         if (sscanf(time, "%d:%d", &hour, &min) != 2 || hour < 0 || hour > 23 || min < 0 || min > 59) {
             ESP_LOGE(TAG, "Time không hợp lệ: %s", time);
-            return;
+            return ESP_ERR_INVALID_ARG;
+        }
+        int st = reminder_status_from_str(status);
+        if (st < 0) {
+            ESP_LOGE(TAG, "Trạng thái không hợp lệ: %s", status);
+            return ESP_ERR_INVALID_ARG;
+        }
+        store_cmd_init(c, STORE_CMD_ADD, id, false);
+        if (date[0] && !date_to_day(date, &c->day)) {
+            ESP_LOGW(TAG, "Ngày không hợp lệ cho ID %d: %s", id, date);
         }
-        int new_id = (id == -1) ? next_id : id;
-        ESP_LOGI(TAG, "Gọi add_reminder_full: id=%d", new_id);
-        add_reminder_full_nr(new_id, date, hour, min, content, status);
-        save_reminders_to_nvs();
+        c->min_of_day = (uint16_t)(hour * 60 + min);
+        c->status = (ReminderStatus)st;
+        strncpy(c->content, content, CONTENT_LENGTH - 1);
+        if (rule && !recur_parse(rule, &c->rule)) {
+            ESP_LOGE(TAG, "Quy tắc lặp không hợp lệ: %s", rule);
+            return ESP_ERR_INVALID_ARG;
+        }
+        return ESP_OK;
     } else if (strcmp(action, "update") == 0) {
-        xSemaphoreTake(reminders_mutex, portMAX_DELAY);
-        bool found = false;
-        for (int i = 0; i < num_reminders; i++) {
-            if (reminders[i].id == id) {
-                found = true;
-                if (date != NULL && strlen(date) > 0) {
-                    if (strlen(date) != 10 || !strstr(date, "-") || date[4] != '-' || date[7] != '-') {
-                        ESP_LOGE(TAG, "Invalid date format for update ID %d: %s", id, date);
-                    } else {
-                        strncpy(reminders[i].date, date, sizeof(reminders[i].date) - 1);
-                        reminders[i].date[sizeof(reminders[i].date) - 1] = '\0';
-                    }
-                }
-                if (time != NULL && strlen(time) > 0) {
-                    int hour, minute;
-                    if (sscanf(time, "%d:%d", &hour, &minute) != 2) {
-                        ESP_LOGE(TAG, "Invalid time format for update ID %d: %s", id, time);
-                    } else if (hour < 0 || hour > 23 || minute < 0 || minute > 59) {
-                        ESP_LOGE(TAG, "Invalid time values for update ID %d: hour=%d, minute=%d", id, hour, minute);
-                    } else {
-                        reminders[i].hour = hour;
-                        reminders[i].minute = minute;
-                    }
-                }
-                if (content != NULL && strlen(content) > 0) {
-                    if (strlen(content) > 63) {
-                        ESP_LOGE(TAG, "Content too long for update ID %d: %s", id, content);
-                    } else {
-                        strncpy(reminders[i].content, content, sizeof(reminders[i].content) - 1);
-                        reminders[i].content[sizeof(reminders[i].content) - 1] = '\0';
-                    }
-                }
-                if (status != NULL && strlen(status) > 0) {
-                    strncpy(reminders[i].status, status, sizeof(reminders[i].status) - 1);
-                    reminders[i].status[sizeof(reminders[i].status) - 1] = '\0';
-                }
-                ESP_LOGI(TAG, "Cập nhật báo thức ID %d: %s %02d:%02d %s %s", 
-                         id, reminders[i].date, reminders[i].hour, reminders[i].minute, 
-                         reminders[i].content, reminders[i].status);
-                save_reminders_to_nvs();
-                break;
+        store_cmd_init(c, STORE_CMD_UPDATE, id, false);
+        if (date != NULL && strlen(date) > 0) {
+            if (date_to_day(date, &c->day)) c->fields |= STORE_F_DAY;
+            else ESP_LOGE(TAG, "Invalid date format for update ID %d: %s", id, date);
+        }
+        if (time != NULL && strlen(time) > 0) {
+            int hour, minute;
+            if (sscanf(time, "%d:%d", &hour, &minute) != 2) {
+                ESP_LOGE(TAG, "Invalid time format for update ID %d: %s", id, time);
+            } else if (hour < 0 || hour > 23 || minute < 0 || minute > 59) {
+                ESP_LOGE(TAG, "Invalid time values for update ID %d: hour=%d, minute=%d", id, hour, minute);
+            } else {
+                c->min_of_day = (uint16_t)(hour * 60 + minute);
+                c->fields |= STORE_F_TIME;
+            }
+        }
+        if (content != NULL && strlen(content) > 0) {
+            if (strlen(content) > 63) {
+                ESP_LOGE(TAG, "Content too long for update ID %d: %s", id, content);
+            } else {
+                strncpy(c->content, content, CONTENT_LENGTH - 1);
+                c->fields |= STORE_F_CONTENT;
+            }
+        }
+        if (status != NULL && strlen(status) > 0) {
+            int st = reminder_status_from_str(status);
+            if (st < 0) {
+                ESP_LOGE(TAG, "Invalid status for update ID %d: %s", id, status);
+            } else {
+                c->status = (ReminderStatus)st;
+                c->fields |= STORE_F_STATUS;
             }
         }
-        xSemaphoreGive(reminders_mutex);
-        if (!found) {
-            ESP_LOGW(TAG, "Reminder ID %d không tồn tại, bỏ qua cập nhật", id);
+        if (rule != NULL) {
+            if (recur_parse(rule, &c->rule)) c->fields |= STORE_F_RULE;
+            else ESP_LOGE(TAG, "Invalid rule for update ID %d: %s", id, rule);
         }
+        return ESP_OK;
     } else if (strcmp(action, "delete") == 0) {
-      	delete_reminder_at_nr(id);
-        save_reminders_to_nvs();
-	}
+        store_cmd_init(c, STORE_CMD_DELETE, id, false);
+        return ESP_OK;
+    }
+    ESP_LOGE(TAG, "Action không hợp lệ: %s", action);
+    return ESP_ERR_INVALID_ARG;
+}
+
+void sync_reminder(const char *action, int id, const char *date, const char *time, const char *content, const char *status, const char *rule) {
+    StoreCmd c;
+    if (sync_build_cmd(&c, action, id, date, time, content, status, rule) == ESP_OK) store_submit(&c, NULL);
+}
+
+static const char *json_str(const cJSON *obj, const char *key) {
+    const cJSON *it = cJSON_GetObjectItem(obj, key);
+    return cJSON_IsString(it) ? it->valuestring : NULL;
+}
+
+// {"action":"bulk","ops":[{"action":"add",...},...]}: all ops or none.
+void sync_reminders_bulk(const cJSON *ops) {
+    if (!cJSON_IsArray(ops)) {
+        ESP_LOGE(TAG, "bulk: thiếu mảng ops");
+        return;
+    }
+    ReminderTxn *txn = malloc(sizeof(ReminderTxn));
+    if (!txn) {
+        ESP_LOGE(TAG, "bulk: không đủ bộ nhớ");
+        return;
+    }
+    reminders_txn_begin(txn);
+    esp_err_t err = ESP_OK;
+    const cJSON *op;
+    cJSON_ArrayForEach(op, ops) {
+        const char *action = json_str(op, "action");
+        const cJSON *id = cJSON_GetObjectItem(op, "id");
+        StoreCmd c;
+        err = action ? sync_build_cmd(&c, action, cJSON_IsNumber(id) ? id->valueint : -1,
+                                      json_str(op, "date"), json_str(op, "time"),
+                                      json_str(op, "content"), json_str(op, "status"),
+                                      json_str(op, "rule"))
+                     : ESP_ERR_INVALID_ARG;
+        if (err == ESP_OK) err = reminders_txn_apply(txn, &c);
+        if (err != ESP_OK) break;
+    }
+    // Runs on the MQTT task, which the store task needs to publish the
+    // batch: hand the txn over instead of waiting for the commit.
+    if (err != ESP_OK) {
+        free(txn);
+    } else {
+        err = reminders_txn_submit(txn, true);
+    }
+    if (err != ESP_OK) ESP_LOGE(TAG, "bulk: bỏ qua cả lô (%s)", esp_err_to_name(err));
+}
+
+void reminders_publish_locked(void) {
+    int b = 1 - pub_front;
+    ReminderSnapshot *v = &pub_buf[b];
+    uint32_t seq = pub_seq[b];
+    __atomic_store_n(&pub_seq[b], seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    v->count = num_reminders;
+    memcpy(v->rec, reminders, sizeof(v->rec));
+    for (int i = 0; i < num_reminders; i++) {
+        strncpy(v->content[i], reminder_content(&reminders[i]), CONTENT_LENGTH - 1);
+        v->content[i][CONTENT_LENGTH - 1] = 0;
+    }
+    due_index_advance_locked(store_now());
+    const DueEntry *due;
+    v->n_due = due_index_view_locked(&due);
+    memcpy(v->due, due, v->n_due * sizeof(DueEntry));
+    v->version = pub_version + 1;
+    __atomic_store_n(&pub_seq[b], seq + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&pub_front, b, __ATOMIC_RELEASE);
+    __atomic_store_n(&pub_version, v->version, __ATOMIC_RELEASE);
+    sched_kick();
+}
+
+uint32_t reminders_version(void) {
+    return __atomic_load_n(&pub_version, __ATOMIC_ACQUIRE);
+}
+
+uint32_t reminders_snapshot(ReminderSnapshot *out) {
+    for (;;) {
+        int f = __atomic_load_n(&pub_front, __ATOMIC_ACQUIRE);
+        uint32_t seq = __atomic_load_n(&pub_seq[f], __ATOMIC_ACQUIRE);
+        if (!(seq & 1)) {
+            memcpy(out, &pub_buf[f], sizeof(*out));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&pub_seq[f], __ATOMIC_RELAXED) == seq) return out->version;
+        }
+        vTaskDelay(1);
+    }
 }
 
 static esp_err_t nvs_init_once(void) {
@@ -336,29 +841,351 @@ static esp_err_t nvs_init_once(void) {
     return err;
 }
 
-esp_err_t save_reminders_to_nvs(void) {
-    ESP_ERROR_CHECK(nvs_init_once());
+static uint32_t store_crc(const Reminder *recs, int count, const char *pool, int pool_len) {
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)recs, count * sizeof(Reminder));
+    return esp_rom_crc32_le(crc, (const uint8_t *)pool, pool_len);
+}
+
+static void store_snapshot_persisted(const Reminder *recs, int count, const char *pool, int pool_len) {
+    memcpy(persisted, recs, count * sizeof(Reminder));
+    persisted_count = count;
+    memcpy(persisted_pool, pool, pool_len);
+    persisted_pool_used = pool_len;
+    persisted_valid = true;
+}
+
+static void store_take_snapshot(void) {
+    if (reminders_mutex) xSemaphoreTake(reminders_mutex, portMAX_DELAY);
+    snap_count = num_reminders;
+    snap_next_id = next_id;
+    memcpy(snap, reminders, snap_count * sizeof(Reminder));
+    memcpy(snap_pool, content_pool, pool_used);
+    snap_pool_used = pool_used;
+    if (reminders_mutex) xSemaphoreGive(reminders_mutex);
+}
+
+static uint32_t store_dirty_mask(void) {
+    uint32_t mask = 0;
+    for (int i = 0; i < snap_count; i++) {
+        if (!persisted_valid || i >= persisted_count ||
+            memcmp(&snap[i], &persisted[i], sizeof(Reminder)) != 0) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+
+static esp_err_t store_write_snapshot(void) {
+    if (stored_schema > STORE_SCHEMA_VERSION) {
+        // Written by newer firmware; leave it for that firmware to read.
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    uint32_t dirty = store_dirty_mask();
+    bool pool_dirty = !persisted_valid || snap_pool_used != persisted_pool_used ||
+                      memcmp(snap_pool, persisted_pool, snap_pool_used) != 0;
+    if (persisted_valid && dirty == 0 && !pool_dirty && snap_count == persisted_count) {
+        ESP_LOGD(TAG, "NVS đã cập nhật, bỏ qua");
+        return ESP_OK;
+    }
     nvs_handle_t h;
     esp_err_t err = nvs_open("reminders", NVS_READWRITE, &h);
     if (err != ESP_OK) { ESP_LOGE(TAG, "NVS open fail: %s", esp_err_to_name(err)); return err; }
-    err = nvs_set_i32(h, "num_reminders", num_reminders);
-    if (err != ESP_OK) { nvs_close(h); return err; }
-    extern int next_id;
-    err = nvs_set_i32(h, "next_id", next_id);
-    if (err != ESP_OK) { nvs_close(h); return err; }
-    for (int i = 0; i < num_reminders; i++) {
+    size_t written = 0;
+    int n_written = 0;
+    for (int i = 0; i < snap_count; i++) {
+        if (!(dirty & (1u << i))) continue;
         char key[32];
         snprintf(key, sizeof(key), "reminder_%d", i);
-        err = nvs_set_blob(h, key, &reminders[i], sizeof(Reminder));
+        err = nvs_set_blob(h, key, &snap[i], sizeof(Reminder));
         if (err != ESP_OK) { ESP_LOGE(TAG, "Save blob %d fail: %s", i, esp_err_to_name(err)); nvs_close(h); return err; }
+        written += sizeof(Reminder);
+        n_written++;
+    }
+    for (int i = snap_count; i < persisted_count; i++) {
+        char key[32];
+        snprintf(key, sizeof(key), "reminder_%d", i);
+        nvs_erase_key(h, key);
+    }
+    if (pool_dirty) {
+        err = nvs_set_blob(h, "content_pool", snap_pool, snap_pool_used);
+        if (err != ESP_OK) { ESP_LOGE(TAG, "Save content pool fail: %s", esp_err_to_name(err)); nvs_close(h); return err; }
+        written += snap_pool_used;
+    }
+    StoreHeader hdr = {
+        .gen      = store_gen + 1,
+        .crc      = store_crc(snap, snap_count, snap_pool, snap_pool_used),
+        .next_id  = (uint16_t)snap_next_id,
+        .pool_len = (uint16_t)snap_pool_used,
+        .count    = (uint8_t)snap_count,
+    };
+    err = nvs_set_blob(h, "hdr", &hdr, sizeof(hdr));
+    if (err != ESP_OK) { ESP_LOGE(TAG, "Save header fail: %s", esp_err_to_name(err)); nvs_close(h); return err; }
+    written += sizeof(hdr);
+    if (stored_schema != STORE_SCHEMA_VERSION) {
+        nvs_erase_key(h, "num_reminders");
+        nvs_erase_key(h, "next_id");
+        err = nvs_set_u8(h, "schema", STORE_SCHEMA_VERSION);
+        if (err != ESP_OK) { ESP_LOGE(TAG, "Save schema fail: %s", esp_err_to_name(err)); nvs_close(h); return err; }
     }
     err = nvs_commit(h);
     nvs_close(h);
-    ESP_LOGI(TAG, "Saved %d reminders to NVS", num_reminders);
+    if (err != ESP_OK) return err;
+    stored_schema = STORE_SCHEMA_VERSION;
+    store_gen = hdr.gen;
+    store_snapshot_persisted(snap, snap_count, snap_pool, snap_pool_used);
+    ESP_LOGI(TAG, "Saved %d/%d reminders to NVS (gen %u, %u bytes)",
+             n_written, snap_count, (unsigned)store_gen, (unsigned)written);
+    return ESP_OK;
+}
+
+static void journal_rec_from(JournalRecord *j, JournalOp op, const Reminder *r) {
+    memset(j, 0, sizeof(*j));
+    j->op = op;
+    j->id = r->id;
+    j->day = r->day;
+    j->min_of_day = r->min_of_day;
+    j->status = r->status;
+    strncpy(j->content, content_at(r, snap_pool, snap_pool_used), CONTENT_LENGTH - 1);
+}
+
+// PUT resets the rule; a RULE record follows whenever the rule is set,
+// whatever the status, matching what the NVS blob keeps.
+static int journal_put(JournalRecord *j, const Reminder *r) {
+    journal_rec_from(&j[0], JOURNAL_OP_PUT, r);
+    if (r->rule.kind == RECUR_NONE && r->rule.arg == 0 && r->rule.until == 0) return 1;
+    memset(&j[1], 0, sizeof(j[1]));
+    j[1].op = JOURNAL_OP_RULE;
+    j[1].id = r->id;
+    j[1].status = r->rule.kind;
+    j[1].min_of_day = r->rule.arg;
+    j[1].day = r->rule.until;
+    return 2;
+}
+
+static bool same_as_persisted(const Reminder *r, const Reminder *p) {
+    return r->day == p->day && r->min_of_day == p->min_of_day && r->status == p->status &&
+           memcmp(&r->rule, &p->rule, sizeof(RecurRule)) == 0 &&
+           strcmp(content_at(r, snap_pool, snap_pool_used),
+                  content_at(p, persisted_pool, persisted_pool_used)) == 0;
+}
+
+static int find_by_id(const Reminder *recs, int count, int id) {
+    for (int i = 0; i < count; i++) if (recs[i].id == id) return i;
+    return -1;
+}
+
+// Journal counterpart of store_write_snapshot: appends PUT/DEL/META for what
+// changed since the last write, or checkpoints when the head sector is full.
+static esp_err_t store_write_journal(void) {
+    static JournalRecord ops[3 * MAX_REMINDERS + 1];
+    static JournalRecord hist[HISTORY_QUEUE_LEN];
+    int n = 0, n_hist = 0;
+    bool checkpoint = !persisted_valid || !journal_has_state();
+    if (!checkpoint) {
+        for (int i = 0; i < snap_count; i++) {
+            int j = find_by_id(persisted, persisted_count, snap[i].id);
+            if (j < 0 || !same_as_persisted(&snap[i], &persisted[j])) n += journal_put(&ops[n], &snap[i]);
+        }
+        for (int j = 0; j < persisted_count; j++) {
+            if (find_by_id(snap, snap_count, persisted[j].id) < 0) journal_rec_from(&ops[n++], JOURNAL_OP_DEL, &persisted[j]);
+        }
+        if (snap_next_id != persisted_next_id) {
+            memset(&ops[n], 0, sizeof(ops[n]));
+            ops[n].op = JOURNAL_OP_META;
+            ops[n++].id = (uint16_t)snap_next_id;
+        }
+    }
+    char msg[CONTENT_LENGTH];
+    while (n_hist < HISTORY_QUEUE_LEN && history_queue && xQueueReceive(history_queue, msg, 0) == pdTRUE) {
+        memset(&hist[n_hist], 0, sizeof(hist[n_hist]));
+        hist[n_hist].op = JOURNAL_OP_HISTORY;
+        memcpy(hist[n_hist].content, msg, CONTENT_LENGTH);
+        n_hist++;
+    }
+    if (!checkpoint && n == 0 && n_hist == 0) {
+        ESP_LOGD(TAG, "Journal đã cập nhật, bỏ qua");
+        return ESP_OK;
+    }
+    if (n + n_hist > journal_free_records()) checkpoint = true;
+    esp_err_t err = ESP_OK;
+    if (checkpoint) {
+        n = 0;
+        for (int i = 0; i < snap_count; i++) n += journal_put(&ops[n], &snap[i]);
+        memset(&ops[n], 0, sizeof(ops[n]));
+        ops[n].op = JOURNAL_OP_META;
+        ops[n++].id = (uint16_t)snap_next_id;
+        err = journal_checkpoint(ops, n);
+    } else {
+        for (int i = 0; err == ESP_OK && i < n; i++) err = journal_append(&ops[i]);
+    }
+    for (int i = 0; err == ESP_OK && i < n_hist; i++) err = journal_append(&hist[i]);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Ghi journal thất bại: %s", esp_err_to_name(err));
+        persisted_valid = false;
+        return err;
+    }
+    store_snapshot_persisted(snap, snap_count, snap_pool, snap_pool_used);
+    persisted_next_id = snap_next_id;
+    ESP_LOGI(TAG, "Journal: %s %d bản ghi, %d lịch sử", checkpoint ? "checkpoint" : "append", n, n_hist);
+    return ESP_OK;
+}
+
+static void store_apply_journal(const JournalRecord *j, void *ctx) {
+    int i = reminder_index_by_id_locked(j->id);
+    switch (j->op) {
+    case JOURNAL_OP_PUT: {
+        if (i < 0 && num_reminders >= MAX_REMINDERS) return;
+        Reminder rec = {0};
+        rec.id = j->id;
+        rec.day = j->day;
+        rec.min_of_day = j->min_of_day;
+        rec.status = (j->status <= REM_STATUS_REPEAT) ? j->status : REM_STATUS_PENDING;
+        char c[CONTENT_LENGTH];
+        memcpy(c, j->content, sizeof(c));
+        c[sizeof(c) - 1] = 0;
+        // A full pool must not turn the content into preset 0 for good:
+        // keep a shorter copy, or drop the record, and say so.
+        size_t len = strlen(c);
+        while (!reminder_set_content_locked(&rec, c)) {
+            if (len < 8) {
+                ESP_LOGE(TAG, "Journal: bỏ báo thức ID %u, bộ nhớ nội dung đầy", (unsigned)j->id);
+                return;
+            }
+            len /= 2;
+            c[len] = 0;
+            ESP_LOGW(TAG, "Journal: cắt nội dung ID %u còn %u ký tự", (unsigned)j->id, (unsigned)len);
+        }
+        if (i < 0) i = num_reminders++;
+        reminders[i] = rec;
+        break;
+    }
+    case JOURNAL_OP_DEL:
+        if (i < 0) return;
+        for (; i < num_reminders - 1; i++) reminders[i] = reminders[i + 1];
+        memset(&reminders[num_reminders - 1], 0, sizeof(Reminder));
+        num_reminders--;
+        break;
+    case JOURNAL_OP_RULE:
+        if (i < 0 || j->status > RECUR_MONTHLY) return;
+        reminders[i].rule.kind = j->status;
+        reminders[i].rule.arg = (uint8_t)j->min_of_day;
+        reminders[i].rule.until = j->day;
+        break;
+    case JOURNAL_OP_META:
+        next_id = j->id;
+        break;
+    default:
+        break;
+    }
+}
+
+static esp_err_t store_load_journal_locked(void) {
+    num_reminders = 0;
+    pool_used = 0;
+    next_id = 1;
+    memset(reminders, 0, sizeof(reminders));
+    esp_err_t err = journal_replay(store_apply_journal, NULL);
+    if (err != ESP_OK) return err;
+    due_index_invalidate();
+    reminders_publish_locked();
+    store_snapshot_persisted(reminders, num_reminders, content_pool, pool_used);
+    persisted_next_id = next_id;
+    ESP_LOGI(TAG, "Loaded %d reminders from journal", num_reminders);
+    return ESP_OK;
+}
+
+esp_err_t save_reminders_to_nvs(void) {
+    ESP_ERROR_CHECK(nvs_init_once());
+    if (persist_mutex) xSemaphoreTake(persist_mutex, portMAX_DELAY);
+    store_take_snapshot();
+    esp_err_t err = journal_available() ? store_write_journal() : store_write_snapshot();
+    if (persist_mutex) xSemaphoreGive(persist_mutex);
     return err;
 }
 
-esp_err_t load_reminders_from_nvs(void) {
+// One reader per NVS layout this firmware can still load. A layout change
+// bumps STORE_SCHEMA_VERSION and adds a reader; load decodes every record
+// into the current form in one pass and the next save writes it back.
+typedef struct {
+    size_t    rec_size;
+    esp_err_t (*read_meta)(nvs_handle_t h, StoreHeader *hdr);
+    void      (*decode)(Reminder *out, const void *raw);
+} SchemaReader;
+
+static esp_err_t read_meta_keys(nvs_handle_t h, StoreHeader *hdr) {
+    int32_t count = 0, nid = 1;
+    esp_err_t err = nvs_get_i32(h, "num_reminders", &count);
+    if (err == ESP_OK) err = nvs_get_i32(h, "next_id", &nid);
+    if (err != ESP_OK) return err;
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->count   = (uint8_t)((count < 0) ? 0 : (count > MAX_REMINDERS) ? MAX_REMINDERS : count);
+    hdr->next_id = (uint16_t)nid;
+    return ESP_OK;
+}
+
+static esp_err_t read_meta_hdr(nvs_handle_t h, StoreHeader *hdr) {
+    size_t sz = sizeof(*hdr);
+    esp_err_t err = nvs_get_blob(h, "hdr", hdr, &sz);
+    if (err == ESP_OK && sz != sizeof(*hdr)) err = ESP_ERR_NVS_INVALID_LENGTH;
+    return err;
+}
+
+static void decode_legacy(Reminder *out, const void *raw) {
+    reminder_from_legacy_locked(out, (const LegacyReminder *)raw);
+}
+
+static void decode_v3(Reminder *out, const void *raw) {
+    const ReminderV3 *r = raw;
+    memset(out, 0, sizeof(*out));
+    out->id = r->id;
+    out->day = r->day;
+    out->min_of_day = r->min_of_day;
+    out->status = r->status;
+    out->pooled = r->pooled;
+    out->content = r->content;
+}
+
+static void decode_compact(Reminder *out, const void *raw) {
+    memcpy(out, raw, sizeof(Reminder));
+}
+
+// NVS records are trusted no more than journal ones: the renderers index
+// tables by status and the pool by offset. Every uint16 day is a valid date.
+static void reminder_sanitize_locked(Reminder *r) {
+    if (r->status > REM_STATUS_REPEAT) {
+        ESP_LOGW(TAG, "ID %u: trạng thái %u không hợp lệ", (unsigned)r->id, (unsigned)r->status);
+        r->status = REM_STATUS_REPEAT;
+    }
+    if (r->min_of_day >= 24 * 60) {
+        ESP_LOGW(TAG, "ID %u: giờ %u không hợp lệ", (unsigned)r->id, (unsigned)r->min_of_day);
+        r->min_of_day = 0;
+    }
+    bool content_ok = r->pooled ? (r->content < pool_used && (r->content == 0 || content_pool[r->content - 1] == 0))
+                                : (r->content < NUM_CONTENT_PRESETS);
+    if (!content_ok) {
+        ESP_LOGW(TAG, "ID %u: nội dung %u không hợp lệ", (unsigned)r->id, (unsigned)r->content);
+        r->pooled = 0;
+        r->content = 0;
+    }
+    if (r->rule.kind > RECUR_MONTHLY) memset(&r->rule, 0, sizeof(r->rule));
+}
+
+static const SchemaReader SCHEMA_READERS[STORE_SCHEMA_VERSION + 1] = {
+    [1] = { sizeof(LegacyReminder), read_meta_keys, decode_legacy },   // 104-byte structs
+    [2] = { sizeof(ReminderV3),     read_meta_keys, decode_v3 },       // packed records + pool
+    [3] = { sizeof(ReminderV3),     read_meta_hdr,  decode_v3 },       // + header with gen/crc
+    [4] = { sizeof(Reminder),       read_meta_hdr,  decode_compact },  // + recurrence rule
+};
+
+// Stores written before the "schema" key existed.
+static uint8_t schema_detect(nvs_handle_t h) {
+    size_t sz = 0;
+    if (nvs_get_blob(h, "hdr", NULL, &sz) == ESP_OK) return 3;
+    if (nvs_get_blob(h, "reminder_0", NULL, &sz) == ESP_OK && sz == sizeof(LegacyReminder)) return 1;
+    return 2;
+}
+
+static esp_err_t store_load_nvs_locked(bool *resave) {
     ESP_ERROR_CHECK(nvs_init_once());
     nvs_handle_t h;
     esp_err_t err = nvs_open("reminders", NVS_READONLY, &h);
@@ -366,22 +1193,121 @@ esp_err_t load_reminders_from_nvs(void) {
         ESP_LOGW(TAG, "No 'reminders' namespace; start empty");
         num_reminders = 0;
         extern int next_id; next_id = 1;
+        stored_schema = 0;
         return ESP_OK;
     }
     if (err != ESP_OK) { ESP_LOGE(TAG, "NVS open fail: %s", esp_err_to_name(err)); return err; }
-    err = nvs_get_i32(h, "num_reminders", &num_reminders);
-    if (err != ESP_OK) { nvs_close(h); return err; }
-    extern int next_id;
-    err = nvs_get_i32(h, "next_id", &next_id);
+    uint8_t version = 0;
+    if (nvs_get_u8(h, "schema", &version) != ESP_OK) version = schema_detect(h);
+    if (version == 0 || version > STORE_SCHEMA_VERSION) {
+        ESP_LOGE(TAG, "Schema NVS %u không được hỗ trợ (firmware %d)", version, STORE_SCHEMA_VERSION);
+        stored_schema = version;
+        nvs_close(h);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    const SchemaReader *rd = &SCHEMA_READERS[version];
+    StoreHeader hdr;
+    err = rd->read_meta(h, &hdr);
     if (err != ESP_OK) { nvs_close(h); return err; }
-    if (num_reminders > MAX_REMINDERS) num_reminders = MAX_REMINDERS;
+    num_reminders = (hdr.count > MAX_REMINDERS) ? MAX_REMINDERS : hdr.count;
+    next_id       = hdr.next_id;
+    store_gen     = hdr.gen;
+    size_t pool_sz = sizeof(content_pool);
+    if (nvs_get_blob(h, "content_pool", content_pool, &pool_sz) == ESP_OK) pool_used = (int)pool_sz;
+    else pool_used = 0;
+    if (pool_used > 0) content_pool[pool_used - 1] = 0;
+    union { LegacyReminder legacy; ReminderV3 v3; Reminder compact; } raw;
     for (int i = 0; i < num_reminders; i++) {
         char key[32]; snprintf(key, sizeof(key), "reminder_%d", i);
-        size_t sz = sizeof(Reminder);
-        err = nvs_get_blob(h, key, &reminders[i], &sz);
+        size_t sz = sizeof(raw);
+        err = nvs_get_blob(h, key, &raw, &sz);
+        // A current-size slot under an older schema: upgrade interrupted after that slot.
+        void (*decode)(Reminder *, const void *) = (sz == rd->rec_size) ? rd->decode :
+                                                   (sz == sizeof(Reminder)) ? decode_compact : NULL;
+        if (err == ESP_OK && !decode) err = ESP_ERR_NVS_INVALID_LENGTH;
         if (err != ESP_OK) { ESP_LOGE(TAG, "Load blob %d fail: %s", i, esp_err_to_name(err)); nvs_close(h); return err; }
+        decode(&reminders[i], &raw);
+        reminder_sanitize_locked(&reminders[i]);
     }
     nvs_close(h);
-    ESP_LOGI(TAG, "Loaded %d reminders from NVS", num_reminders);
+    stored_schema = version;
+    due_index_invalidate();
+    reminders_publish_locked();
+    ESP_LOGI(TAG, "Loaded %d reminders from NVS (schema %u, gen %u)", num_reminders, version, (unsigned)store_gen);
+    if (version < STORE_SCHEMA_VERSION) {
+        ESP_LOGI(TAG, "Nâng cấp schema NVS %u -> %d", version, STORE_SCHEMA_VERSION);
+        *resave = true;
+        return ESP_OK;
+    }
+    if (hdr.pool_len != pool_used || hdr.crc != store_crc(reminders, num_reminders, content_pool, pool_used)) {
+        // Header from an earlier save than some records: rewrite everything.
+        ESP_LOGW(TAG, "Phát hiện lần lưu NVS bị gián đoạn (gen %u), ghi lại toàn bộ", (unsigned)store_gen);
+        *resave = true;
+        return ESP_OK;
+    }
+    store_snapshot_persisted(reminders, num_reminders, content_pool, pool_used);
+    return ESP_OK;
+}
+
+// Prefers the journal partition; NVS is only read to seed an empty journal
+// and remains the store on partition tables without one.
+static esp_err_t store_load_locked(bool *resave) {
+    if (journal_init() != ESP_OK) return store_load_nvs_locked(resave);
+    if (journal_has_state()) return store_load_journal_locked();
+    esp_err_t err = store_load_nvs_locked(resave);
+    if (err != ESP_OK) return err;
+    ESP_LOGI(TAG, "Chuyển %d báo thức từ NVS sang journal", num_reminders);
+    *resave = true;
     return ESP_OK;
-}
\ No newline at end of file
+}
+
+// Boot only, before the store task owns the table. The rewrite after an
+// upgrade or migration snapshots under the mutex, so it runs after release.
+esp_err_t load_reminders_from_nvs(void) {
+    if (!reminders_mutex) reminders_mutex = xSemaphoreCreateMutex();
+    bool resave = false;
+    xSemaphoreTake(reminders_mutex, portMAX_DELAY);
+    persisted_valid = false;
+    esp_err_t err = store_load_locked(&resave);
+    xSemaphoreGive(reminders_mutex);
+    if (err == ESP_OK && resave) err = save_reminders_to_nvs();
+    return err;
+}
+
+static void persist_task(void *arg) {
+    while (1) {
+        uint32_t bits = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &bits, portMAX_DELAY);
+        TickType_t deadline = xTaskGetTickCount() + pdMS_TO_TICKS(CONFIG_REMINDERS_PERSIST_COALESCE_MS);
+        while (!(bits & PERSIST_FLUSH)) {
+            TickType_t now = xTaskGetTickCount();
+            if ((int32_t)(deadline - now) <= 0) break;
+            uint32_t more = 0;
+            if (xTaskNotifyWait(0, UINT32_MAX, &more, deadline - now) == pdTRUE) bits |= more;
+        }
+        esp_err_t err = save_reminders_to_nvs();
+        if (err != ESP_OK) ESP_LOGE(TAG, "Lưu NVS thất bại: %s", esp_err_to_name(err));
+    }
+}
+
+static void persist_on_shutdown(void) {
+    save_reminders_to_nvs();
+}
+
+void reminders_persist_start(void) {
+    if (persist_task_handle) return;
+    persist_mutex = xSemaphoreCreateMutex();
+    if (journal_available()) history_queue = xQueueCreate(HISTORY_QUEUE_LEN, CONTENT_LENGTH);
+    xTaskCreatePinnedToCore(persist_task, "persist", 4096, NULL, 3, &persist_task_handle, 0);
+    esp_register_shutdown_handler(persist_on_shutdown);
+}
+
+void reminders_persist_request(void) {
+    if (persist_task_handle) xTaskNotify(persist_task_handle, PERSIST_DIRTY, eSetBits);
+    else ESP_LOGW(TAG, "persist task chưa chạy, bỏ qua yêu cầu lưu");
+}
+
+void reminders_persist_flush(void) {
+    if (persist_task_handle) xTaskNotify(persist_task_handle, PERSIST_FLUSH, eSetBits);
+    else ESP_LOGW(TAG, "persist task chưa chạy, bỏ qua yêu cầu lưu");
+}
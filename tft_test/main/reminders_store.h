@@ -1,6 +1,7 @@
 #pragma once
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include <stdlib.h>
 #include <stdbool.h>
 #include "esp_err.h"
@@ -9,17 +10,40 @@
 #include "nvs.h"         
 #include "nvs_flash.h"
 #include "mqtt.h"
+#include "due_index.h"
+#include "recur.h"
 #define MAX_REMINDERS 16
+#define CONTENT_POOL_SIZE 256
 
+typedef enum {
+    REM_STATUS_PENDING   = 0,
+    REM_STATUS_COMPLETED = 1,
+    REM_STATUS_REPEAT    = 2,
+} ReminderStatus;
+
+// 12 bytes per record: day = days since 1970-01-01 (0 = no date),
+// content = preset id, or offset into the content pool when pooled.
 typedef struct {
-    int  id;                
-    char date[11];          
-    int  hour;              
-    int  minute;            
-    char content[64];       
-    char status[16];        
+    uint16_t id;
+    uint16_t day;
+    uint16_t min_of_day;
+    uint8_t  status : 2;
+    uint8_t  pooled : 1;
+    uint8_t  flags  : 5;
+    uint8_t  content;
+    RecurRule rule;
 } Reminder;
 
+static inline int reminder_hour(const Reminder *r) { return r->min_of_day / 60; }
+static inline int reminder_min(const Reminder *r)  { return r->min_of_day % 60; }
+static inline void reminder_set_time(Reminder *r, int hour, int min) { r->min_of_day = (uint16_t)(hour*60 + min); }
+
+// Next occurrence at or after the minute containing now, or -1.
+time_t reminder_next_fire(const Reminder *r, time_t now);
+
+extern const char* CONTENT_PRESETS[];
+extern const int NUM_CONTENT_PRESETS;
+
 extern int next_id;
 extern int num_reminders;
 extern int pick_index;
@@ -27,14 +51,107 @@ extern Reminder reminders[];
 extern SemaphoreHandle_t reminders_mutex;
 
 void recompute_next_id_locked(void);
+int  reminder_index_by_id_locked(int id);
+const char *reminder_status_str(ReminderStatus status);
+int  reminder_status_from_str(const char *s);
+const char *reminder_content(const Reminder *r);
+bool reminder_set_content_locked(Reminder *r, const char *content);
+void reminder_date_str(const Reminder *r, char out[11]);
 void reminders_recalc(void);
-void add_reminder_full(int id, const char *date, int hour, int min, const char *content, const char *status);
-void add_reminder_full_nr(int id, const char *date, int hour, int min, const char *content, const char *status);
-void update_reminder(int id, const char *date, int hour, int min, const char *content, const char *status);
+
+// All table mutations go through the store task, which applies queued
+// commands in order under reminders_mutex and publishes/persists after
+// releasing it. The functions below are wrappers that build commands.
+typedef enum {
+    STORE_CMD_ADD = 0,     // id == -1 allocates next_id
+    STORE_CMD_UPDATE,
+    STORE_CMD_DELETE,
+    STORE_CMD_TXN,         // txn points at a ReminderTxn
+} StoreCmdType;
+
+#define STORE_F_DAY      (1u << 0)
+#define STORE_F_TIME     (1u << 1)
+#define STORE_F_CONTENT  (1u << 2)
+#define STORE_F_STATUS   (1u << 3)
+#define STORE_F_RULE     (1u << 4)
+
+// Completion token; never wait on one while holding reminders_mutex.
+typedef struct {
+    StaticSemaphore_t buf;
+    SemaphoreHandle_t done;
+    esp_err_t         result;
+    int               id;      // id the command ended up touching
+} StoreToken;
+
+typedef struct ReminderTxn ReminderTxn;
+
+typedef struct {
+    StoreCmdType   type;
+    uint8_t        fields;     // STORE_F_* applied by UPDATE
+    bool           publish;    // echo the change on MQTT
+    bool           urgent;     // persist without the write-behind window
+    int            id;
+    uint16_t       day;
+    uint16_t       min_of_day;
+    ReminderStatus status;
+    char           content[CONTENT_LENGTH];
+    RecurRule      rule;
+    const ReminderTxn *txn;
+    bool           txn_owned;  // store task frees txn once applied
+    StoreToken    *token;
+} StoreCmd;
+
+// Commands applied all-or-nothing by the store task, persisted once and
+// announced in one "reminders/batch" message. The caller owns the storage;
+// commit blocks until the store task is done with it. submit hands a heap
+// txn to the store task without waiting, for callers (the MQTT task) that
+// must not block on a store task that may itself be publishing.
+#define STORE_TXN_MAX_OPS 32
+
+struct ReminderTxn {
+    int      n;
+    StoreCmd ops[STORE_TXN_MAX_OPS];
+};
+
+void      reminders_txn_begin(ReminderTxn *txn);
+esp_err_t reminders_txn_apply(ReminderTxn *txn, const StoreCmd *cmd);
+esp_err_t reminders_txn_commit(ReminderTxn *txn, bool publish);
+esp_err_t reminders_txn_submit(ReminderTxn *txn, bool publish);
+
+void      reminders_store_start(void);
+esp_err_t store_submit(StoreCmd *cmd, StoreToken *tok);
+void      store_token_init(StoreToken *tok);
+esp_err_t store_token_wait(StoreToken *tok, TickType_t ticks);
+void add_reminder_full(int id, const char *date, int hour, int min, const char *content, ReminderStatus status);
+void add_reminder_full_nr(int id, const char *date, int hour, int min, const char *content, ReminderStatus status);
+void update_reminder(int id, const char *date, int hour, int min, const char *content, ReminderStatus status);
 void delete_reminder_at(int idx);
 void delete_reminder_at_nr(int id);
-void update_reminder_status(int id, const char *status);
+void update_reminder_status(int id, ReminderStatus status);
 void send_reminder_history(const char *content);
-void sync_reminder(const char *action, int id, const char *date, const char *time, const char *content, const char *status);
+void sync_reminder(const char *action, int id, const char *date, const char *time, const char *content, const char *status, const char *rule);
+void sync_reminders_bulk(const cJSON *ops);
 esp_err_t save_reminders_to_nvs(void);
-esp_err_t load_reminders_from_nvs(void);
\ No newline at end of file
+esp_err_t load_reminders_from_nvs(void);
+
+// Write-behind persistence: request() coalesces bursts of edits,
+// flush() saves as soon as the worker runs. Both are safe with reminders_mutex held.
+void reminders_persist_start(void);
+
+// Published copy of the table for renderers. Writers call
+// reminders_publish_locked() after changing the table; readers copy the
+// latest version without taking reminders_mutex.
+typedef struct {
+    uint32_t version;
+    int      count;
+    Reminder rec[MAX_REMINDERS];
+    char     content[MAX_REMINDERS][CONTENT_LENGTH];
+    int      n_due;
+    DueEntry due[MAX_REMINDERS];
+} ReminderSnapshot;
+
+void     reminders_publish_locked(void);
+uint32_t reminders_version(void);
+uint32_t reminders_snapshot(ReminderSnapshot *out);
+void reminders_persist_request(void);
+void reminders_persist_flush(void);
\ No newline at end of file
@@ -0,0 +1,38 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "reminders_store.h"
+#include "due_index.h"
+#include "scheduler.h"
+#include "vclock.h"
+
+static TaskHandle_t sched_task = NULL;
+
+void sched_bind_current_task(void) {
+    sched_task = xTaskGetCurrentTaskHandle();
+}
+
+void sched_kick(void) {
+    if (sched_task) xTaskNotifyGive(sched_task);
+}
+
+// Clock redraws are driven by time-service rollover kicks; only alarms
+// bound the sleep here.
+time_t sched_next_wake(time_t now) {
+    time_t next = now + SCHED_MAX_SLEEP_S;
+    DueEntry due;
+    xSemaphoreTake(reminders_mutex, portMAX_DELAY);
+    due_index_advance_locked(now);
+    bool have = due_index_peek_locked(&due);
+    xSemaphoreGive(reminders_mutex);
+    // Anything at or before now has not been taken yet: wake straight away.
+    if (have) next = (due.at > now) ? (due.at < next ? due.at : next) : now;
+    return (next < now) ? now : next;
+}
+
+void sched_sleep_until(time_t at) {
+    // vclock_ticks adds a tick so the wake lands after the boundary.
+    TickType_t ticks = vclock_ticks((int64_t)at * 1000000 - vclock_now_us());
+    if (ticks == 0) return;
+    ulTaskNotifyTake(pdTRUE, ticks);
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include <stdbool.h>
+#include <time.h>
+
+// print_time_task sleeps until the next instant that can change the screen
+// or fire an alarm instead of polling. Anything that moves that instant
+// (store edits, time sync, the UI returning to idle, a minute rollover from
+// the time service) calls sched_kick().
+#define SCHED_MAX_SLEEP_S 3600
+
+void   sched_bind_current_task(void);
+void   sched_kick(void);
+time_t sched_next_wake(time_t now);
+void   sched_sleep_until(time_t at);
@@ -2,7 +2,6 @@
 
 #include "soc/gpio_num.h"
 #include "freertos/FreeRTOS.h"
-#include "freertos/event_groups.h"
 #include <string.h>
 #include <time.h>
 #include <sys/time.h>
@@ -10,9 +9,11 @@
 #include <limits.h> 
 #include <strings.h>
 #include "freertos/task.h"
+#include "freertos/queue.h"
 #include "esp_log.h"
 #include "esp_sntp.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 #include "driver/gpio.h"
 #include "display.h"                                
 #include "ldr_gl5537.h"
@@ -24,10 +25,18 @@
 #include "reminders_store.h"
 #include "ui_buttons.h"
 #include "ui_draw.h"
+#include "ui_fsm.h"
+#include "ui_trace.h"
 #include "ldr_service.h"
 #include "time_utils.h"
-
-#define SET_STATE(S)  do { ui_state = (S); ui_epoch++; } while (0)
+#include "due_index.h"
+#include "scheduler.h"
+#include "timer_wheel.h"
+#include "alarm_queue.h"
+#include "vclock.h"
+#include "time_service.h"
+#include "dsleep.h"
+#include "latency.h"
 
 #ifndef LDR_LED_PIN
 #define LDR_LED_PIN      GPIO_NUM_42
@@ -35,34 +44,124 @@
 #ifndef LDR_BUZZER_PIN
 #define LDR_BUZZER_PIN   GPIO_NUM_35
 #endif
-#define EV_ALARM_START  (1<<0)   
-#define EV_GESTURE_DONE (1<<1) 
 #define SNOOZE_SECS  (5*60)
+#define GESTURE_TIMEOUT_S 180
+#define ALARM_ACK_DONE    0
+#define ALARM_ACK_SNOOZE  2
+#define ALARM_ACK_BUTTON  3   // cancel: snooze a repeat, drop a one-shot
+#define ALARM_ACK_MENU    4   // silenced to open or leave the menu
     
-static TaskHandle_t ldr_task_handle = NULL;
+static TaskHandle_t alarm_task_handle = NULL;
 static bool edit_active = false;
 static int edit_day = 1, edit_month = 1, edit_year = 2025; 
 static int edit_hour = 0, edit_min = 0;
 static SemaphoreHandle_t ldr_mutex = NULL;
-static EventGroupHandle_t eg_alarm = NULL;
-static volatile int ldr_cb_code = -1;
-static time_t alarm_started_at = 0;
-static int  alarm_index  = -1;
-static time_t snooze_until = 0;
-static int snooze_index = -1;
-static time_t first_swipe_ts  = 0;
+static volatile int alarm_ack = -1;
+// One outstanding snooze per reminder id; expired ids join the alarm queue.
+typedef struct {
+    TwTimer timer;
+    int     id;
+} Snooze;
+static Snooze snoozes[MAX_REMINDERS];
+static TwTimer gesture_timer;
+static volatile bool gesture_timed_out = false;
 static int shown_hour = -1, shown_min = -1;
 static int shown_y = -1, shown_m = -1, shown_d = -1;
+static uint32_t shown_version = 0;
 static volatile bool  alarm_active = false;
 static bool alarm_screen_visible = false;
+static volatile TickType_t ui_last_input = 0;
+static volatile int64_t ldr_at_us = 0;
 
 TaskHandle_t mail_task = NULL;
 
-static void ldr_cb(int code) { ldr_cb_code = code; }
+static void ldr_cb(int code) {
+    ldr_at_us = esp_timer_get_time();
+    alarm_ack = code;
+    if (alarm_task_handle) xTaskNotifyGive(alarm_task_handle);
+}
+
+static int picked_id(void) {
+    int id = -1;
+    xSemaphoreTake(reminders_mutex, portMAX_DELAY);
+    if (pick_index >= 0 && pick_index < num_reminders) id = reminders[pick_index].id;
+    xSemaphoreGive(reminders_mutex);
+    return id;
+}
+
+static void snooze_expired(TwTimer *t, void *arg) {
+    Snooze *sn = arg;
+    alarm_queue_push(sn->id, ALARM_PRIO_SNOOZE, vclock_now_us());
+}
+
+static void gesture_expired(TwTimer *t, void *arg) {
+    gesture_timed_out = true;
+    if (alarm_task_handle) xTaskNotifyGive(alarm_task_handle);
+}
+
+static void snooze_init(void) {
+    static bool inited = false;
+    if (inited) return;
+    inited = true;
+    alarm_queue_init();
+    for (int k = 0; k < MAX_REMINDERS; k++) tw_init_timer(&snoozes[k].timer, snooze_expired, &snoozes[k]);
+    tw_init_timer(&gesture_timer, gesture_expired, NULL);
+}
+
+// Re-snoozing a reminder restarts its timer rather than taking a new slot.
+static void snooze_start(int id) {
+    Snooze *slot = NULL;
+    for (int k = 0; k < MAX_REMINDERS && id >= 0; k++) {
+        if (tw_pending(&snoozes[k].timer) && snoozes[k].id == id) { slot = &snoozes[k]; break; }
+        if (!slot && !tw_pending(&snoozes[k].timer)) slot = &snoozes[k];
+    }
+    if (!slot) return;
+    slot->id = id;
+    tw_arm(&slot->timer, SNOOZE_SECS);
+}
+
+static void snooze_cancel(int id) {
+    for (int k = 0; k < MAX_REMINDERS; k++) {
+        if (tw_pending(&snoozes[k].timer) && snoozes[k].id == id) tw_cancel(&snoozes[k].timer);
+    }
+}
+
+// Held NEXT/BACK auto-repeat only where they step a number.
+static bool editing_value(void) {
+    switch (ui_state) {
+    case UI_ADD_DATE:
+    case UI_ADD_TIME:  return true;
+    case UI_EDIT_DATE:
+    case UI_EDIT_TIME: return edit_active;
+    default:           return false;
+    }
+}
+
+static void step_time(int delta) {
+    if (field_sel == SEL_HOUR) edit_hour = wrap_step(edit_hour, delta, 0, 23);
+    else edit_min = wrap_step(edit_min, delta, 0, 59);
+}
+
+static void step_date(int delta) {
+    if (two_sel == SEL_LEFT) edit_day = wrap_step(edit_day, delta, 1, civil_days_in_month(edit_year, edit_month));
+    else edit_month = wrap_step(edit_month, delta, 1, 12);
+    clamp_day_month_y(&edit_day, &edit_month, edit_year);
+}
+
+static void submit_edit(uint8_t fields, uint16_t day, int hour, int min, const char *content, bool publish) {
+    StoreCmd c = { .type = STORE_CMD_UPDATE, .fields = fields, .publish = publish, .id = picked_id() };
+    c.day = day;
+    c.min_of_day = (uint16_t)(hour * 60 + min);
+    if (content) strncpy(c.content, content, CONTENT_LENGTH - 1);
+    store_submit(&c, NULL);
+}
 
 void time_sync_notification_cb(struct timeval *tv) {
     if (tv) {
         ESP_LOGI(TAG, "Time synchronized");
+        due_index_invalidate();
+        timesvc_refresh();
+        sched_kick();
     } else {
         ESP_LOGE(TAG, "SNTP callback: Invalid timeval");
     }
@@ -107,87 +206,133 @@ void obtain_time(void) {
     ESP_LOGE(TAG, "SNTP sync failed after %d attempts", retry_count);
 }
 
-static void ldr_event_task(void *pv) {
-    ESP_LOGI(TAG, "LDR task: waiting for alarm events...");
+static void alarm_post_ack(int code) {
+    if (!alarm_active) return;
+    alarm_ack = code;
+    xTaskNotifyGive(alarm_task_handle);
+}
+
+// Rings queued reminders one at a time; print_time_task and the UI only
+// enqueue and post acknowledgements, so neither waits on the user.
+static void alarm_task(void *pv) {
+    ESP_LOGI(TAG, "Alarm task: waiting for due reminders...");
     for (;;) {
-        xEventGroupWaitBits(eg_alarm, EV_ALARM_START, pdTRUE, pdTRUE, portMAX_DELAY);
-        ldr_cb_code = -1;
-        time(&alarm_started_at);
-        first_swipe_ts = 0;
+        AlarmItem it;
+        alarm_queue_pop(&it, portMAX_DELAY);
+        char cont[64], date[11], tbuf[6];
+        bool is_rep = false;
+        xSemaphoreTake(reminders_mutex, portMAX_DELAY);
+        int i = reminder_index_by_id_locked(it.id);
+        if (i >= 0) {
+            strcpy(cont, reminder_content(&reminders[i]));
+            reminder_date_str(&reminders[i], date);
+            is_rep = (reminders[i].status == REM_STATUS_REPEAT);
+            fmt_time(reminder_hour(&reminders[i]), reminder_min(&reminders[i]), tbuf);
+        }
+        xSemaphoreGive(reminders_mutex);
+        if (i < 0) continue;
+        if (it.prio == ALARM_PRIO_SNOOZE) {
+            TimeNow tn;
+            timesvc_read(&tn);
+            fmt_time(tn.tm.tm_hour, tn.tm.tm_min, tbuf);
+        }
+        alarm_ack = -1;
+        ldr_at_us = 0;
+        alarm_active = true;
+        if (ui_state == UI_IDLE) {
+            alarm_screen_visible = true;
+            fill_screen(COLOR_BLACK);
+            draw_string(10, 10, "NHAC NHO:", COLOR_GREEN);
+            draw_string(10, 40, tbuf, COLOR_WHITE);
+            draw_string(10, 70, cont, COLOR_WHITE);
+            draw_string(10, 90, date, COLOR_YELLOW);
+            int64_t late_us = vclock_now_us() - it.due_us;
+            latency_note_alarm((AlarmPrio)it.prio, late_us);
+            dsleep_note_alarm((time_t)(it.due_us / 1000000), late_us);
+            shown_hour = shown_min = -1;
+            shown_y = shown_m = shown_d = -1;
+            if (it.prio != ALARM_PRIO_SNOOZE && mail_task == NULL && !dsleep_offline()) {
+                xTaskCreatePinnedToCore(send_email, "mail_alarm_due", 12288, NULL, 2, &mail_task, 1);
+            }
+        }
+        gesture_timed_out = false;
+        tw_arm(&gesture_timer, GESTURE_TIMEOUT_S);
         ldr_gl5537_set_enabled(&ldr, true); 
 		gpio_set_level(LDR_BUZZER_PIN, 1);             
-        time_t nowt;
-        TickType_t last = xTaskGetTickCount();
-        bool decided = false;
-        while (!decided) {
-            time(&nowt);
-            if (ldr_cb_code < 0 && (nowt - alarm_started_at) >= 180) {
-                xSemaphoreTake(reminders_mutex, portMAX_DELAY);
-                update_reminder_status(reminders[alarm_index].id, "repeat");
-                strncpy(reminders[alarm_index].status, "repeat", sizeof(reminders[alarm_index].status)-1);
-                reminders[alarm_index].status[sizeof(reminders[alarm_index].status)-1] = 0;
-                xSemaphoreGive(reminders_mutex);
-                snooze_index = alarm_index;
-                snooze_until = nowt + SNOOZE_SECS;
-                if (ui_state == UI_IDLE) show_alarm_feedback("BAO LAI SAU 5 PHUT", COLOR_YELLOW);
-                vTaskDelay(pdMS_TO_TICKS(900));
-                gpio_set_level(LDR_BUZZER_PIN, 0);
-                alarm_active = false; alarm_screen_visible = false;
-                shown_hour = shown_min = -1; shown_y = shown_m = shown_d = -1;
-                draw_idle_screen_now();
-                decided = true;
-                break;
-            }
-            int code = ldr_cb_code;
-            if (code == 2) {
-                int was_pending = 0;
-                xSemaphoreTake(reminders_mutex, portMAX_DELAY);
-                update_reminder_status(reminders[alarm_index].id, "repeat");
-                was_pending = (strncasecmp(reminders[alarm_index].status, "pending", 7) == 0);
-                strncpy(reminders[alarm_index].status, "repeat", sizeof(reminders[alarm_index].status)-1);
-                reminders[alarm_index].status[sizeof(reminders[alarm_index].status)-1] = 0;
-                if (was_pending) {
-                    struct tm tm_now = *localtime(&nowt);
-                    int total = tm_now.tm_hour*60 + tm_now.tm_min + 5;
-                    reminders[alarm_index].hour   = (total/60)%24;
-                    reminders[alarm_index].minute = (total%60);
-                }
-                xSemaphoreGive(reminders_mutex);
-                snooze_index = alarm_index;
-                snooze_until = nowt + SNOOZE_SECS;
-                if (ui_state == UI_IDLE) show_alarm_feedback("BAO LAI SAU 5 PHUT", COLOR_YELLOW);
-                vTaskDelay(pdMS_TO_TICKS(900));
-                gpio_set_level(LDR_BUZZER_PIN, 0);
-                alarm_active = false; alarm_screen_visible = false;
-                shown_hour = shown_min = -1; shown_y = shown_m = shown_d = -1;
-                draw_idle_screen_now();
-                decided = true;
+        int code;
+        while ((code = alarm_ack) < 0 && !gesture_timed_out) ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (code < 0) code = ALARM_ACK_SNOOZE;
+        tw_cancel(&gesture_timer);
+        gpio_set_level(LDR_BUZZER_PIN, 0);
+        ldr_gl5537_set_enabled(&ldr, false);
+        if (code == ALARM_ACK_DONE) {
+            update_reminder_status(it.id, REM_STATUS_COMPLETED);
+            snooze_cancel(it.id);
+            if (ui_state == UI_IDLE) {
+                show_alarm_feedback("DA HOAN THANH", COLOR_GREEN);
+                if (ldr_at_us) latency_note_ldr(esp_timer_get_time() - ldr_at_us);
             }
-            else if (code == 0) {
-                xSemaphoreTake(reminders_mutex, portMAX_DELAY);
-                update_reminder_status(reminders[alarm_index].id, "completed");
-                strncpy(reminders[alarm_index].status, "completed", sizeof(reminders[alarm_index].status)-1);
-                reminders[alarm_index].status[sizeof(reminders[alarm_index].status)-1] = 0;
-                xSemaphoreGive(reminders_mutex);
-                snooze_index = -1;
-                if (ui_state == UI_IDLE) show_alarm_feedback("DA HOAN THANH", COLOR_GREEN);
-                vTaskDelay(pdMS_TO_TICKS(900));
-                gpio_set_level(LDR_BUZZER_PIN, 0);
-                alarm_active = false; alarm_screen_visible = false;
-                shown_hour = shown_min = -1; shown_y = shown_m = shown_d = -1;
-                draw_idle_screen_now();
-                decided = true;
+            vTaskDelay(pdMS_TO_TICKS(900));
+        } else if (code == ALARM_ACK_SNOOZE) {
+            update_reminder_status(it.id, REM_STATUS_REPEAT);
+            snooze_start(it.id);
+            if (ui_state == UI_IDLE) {
+                show_alarm_feedback("BAO LAI SAU 5 PHUT", COLOR_YELLOW);
+                if (ldr_at_us) latency_note_ldr(esp_timer_get_time() - ldr_at_us);
             }
-            vTaskDelayUntil(&last, pdMS_TO_TICKS(20));
+            vTaskDelay(pdMS_TO_TICKS(900));
+        } else if (code == ALARM_ACK_BUTTON) {
+            if (is_rep) snooze_start(it.id);
+            else snooze_cancel(it.id);
         }
-        gpio_set_level(LDR_BUZZER_PIN, 0);
-        ldr_gl5537_set_enabled(&ldr, false);
-        xEventGroupSetBits(eg_alarm, EV_GESTURE_DONE);
+        alarm_active = false;
+        alarm_screen_visible = false;
+        shown_hour = shown_min = -1;
+        shown_y = shown_m = shown_d = -1;
+        sched_kick();
     }
 }
 
+#if CONFIG_REMINDERS_DEEP_SLEEP
+// Deep sleep drops RAM, so only go when nothing is ringing, queued or
+// snoozed and the user has left the buttons alone for a while.
+static void maybe_deep_sleep(time_t now) {
+    if (!dsleep_in_window(now) || ui_state != UI_IDLE || alarm_active) return;
+    if (xTaskGetTickCount() - ui_last_input < pdMS_TO_TICKS(CONFIG_REMINDERS_DEEP_SLEEP_IDLE_S * 1000)) return;
+    if (alarm_queue_count() > 0) return;
+    for (int k = 0; k < MAX_REMINDERS; k++) {
+        if (tw_pending(&snoozes[k].timer)) return;
+    }
+    DueEntry due;
+    xSemaphoreTake(reminders_mutex, portMAX_DELAY);
+    bool have = due_index_peek_locked(&due);
+    time_t wm = due_index_watermark_locked();
+    xSemaphoreGive(reminders_mutex);
+    if (have && due.at - now < CONFIG_REMINDERS_DEEP_SLEEP_LEAD_S + 60) return;
+    save_reminders_to_nvs();
+    due_index_save_watermark(wm);
+    fill_screen(COLOR_BLACK);
+    dsleep_enter(now, have ? due.at : 0, wm);
+}
+
+// An offline wake kept awake past the window would never bring the radio
+// up; once nothing is ringing, restart into a normal boot.
+static void maybe_go_online(time_t now) {
+    if (!dsleep_offline() || dsleep_in_window(now) || alarm_active) return;
+    if (alarm_queue_count() > 0) return;
+    time_t wm;
+    xSemaphoreTake(reminders_mutex, portMAX_DELAY);
+    wm = due_index_watermark_locked();
+    xSemaphoreGive(reminders_mutex);
+    ESP_LOGI(TAG, "Het khung gio dem, khoi dong lai de bat Wi-Fi");
+    save_reminders_to_nvs();
+    due_index_save_watermark(wm);
+    esp_restart();
+}
+#endif
+
 void print_time_task(void *pvParam) {
-    if (!eg_alarm)  eg_alarm  = xEventGroupCreate();
+    snooze_init();
     if (!ldr_mutex) ldr_mutex = xSemaphoreCreateMutex();
     ESP_ERROR_CHECK(ldr_gl5537_init(&ldr, LDR_LED_PIN, LDR_BUZZER_PIN, LDR_ADC_CHANNEL, ldr_mutex));
     ldr.double_swipe_time_ms = 5000;  
@@ -198,105 +343,66 @@ void print_time_task(void *pvParam) {
     if (ldr_scan_handle == NULL) {
         xTaskCreatePinnedToCore(ldr_scan_task, "ldr_scan", 3072, NULL, 5, &ldr_scan_handle, 0);
     }
-    if (ldr_task_handle == NULL) {
-        xTaskCreatePinnedToCore(ldr_event_task, "ldr_evt", 4096, NULL, 6, &ldr_task_handle, 0);
+    if (alarm_task_handle == NULL) {
+        xTaskCreatePinnedToCore(alarm_task, "alarm", 4096, NULL, 6, &alarm_task_handle, 0);
     }
     if (!reminders_mutex) {
         reminders_mutex = xSemaphoreCreateMutex();
-    }
-    static bool loaded = false;
-    if (!loaded) {
-        if (load_reminders_from_nvs() == ESP_OK) {
-            loaded = true;
-        }
     }
 	reminders_recalc();
-    TickType_t pt_last = xTaskGetTickCount();
+    sched_bind_current_task();
     ESP_LOGI(TAG, "Starting reminder task");
-    int last_checked_minute = -1;
+    xSemaphoreTake(reminders_mutex, portMAX_DELAY);
+    time_t wm0;
+    if (!dsleep_rtc_watermark(&wm0)) wm0 = due_index_load_watermark();
+    due_index_set_watermark_locked(wm0);
+    xSemaphoreGive(reminders_mutex);
+    time_t next_scan = 0, wm_saved = 0;
     while (1) {
-        time_t now; struct tm timeinfo; char time_buf[64];
-        time(&now); localtime_r(&now, &timeinfo);
+        TimeNow tn;
+        timesvc_read(&tn);
+        time_t now = tn.now;
+        struct tm timeinfo = tn.tm;
+        latency_poll();
         int time_synced = (timeinfo.tm_year >= (2016 - 1900));
             if (!time_synced) {
                 ESP_LOGI(TAG, "CHUA DONG BO THOI GIAN");
             }
-            if (time_synced && timeinfo.tm_min != last_checked_minute) {
-                last_checked_minute = timeinfo.tm_min;
-                char today[11]; fmt_date(timeinfo.tm_year+1900, timeinfo.tm_mon+1, timeinfo.tm_mday, today);
-                bool took=false, released=false;
-                if (reminders_mutex) { xSemaphoreTake(reminders_mutex, portMAX_DELAY); took=true; }
-                for (int i=0; i<num_reminders; i++) {
-                    bool is_repeat = (strncmp(reminders[i].status, "repeat", 6) == 0);
-                    bool is_today  = (strncmp(reminders[i].date, today, 10) == 0);
-                    if ((is_repeat || is_today) &&
-                    timeinfo.tm_hour == reminders[i].hour &&
-                    timeinfo.tm_min  == reminders[i].minute) {
-                        int    r_hour = reminders[i].hour;
-                        int    r_min  = reminders[i].minute;
-                        char   r_cont[64]; strcpy(r_cont, reminders[i].content);
-                        char   r_date[11]; strcpy(r_date, reminders[i].date);
-                        int    idx = i;
-                        send_reminder_history(r_cont);
-                        if (took && !released) { xSemaphoreGive(reminders_mutex); released=true; }
-                        char tbuf[6]; fmt_time(r_hour, r_min, tbuf);
-                        if (ui_state == UI_IDLE) {
-                            fill_screen(COLOR_BLACK);
-                            // gpio_set_level(LDR_BUZZER_PIN, 1);
-                            draw_string(10, 10, "NHAC NHO:", COLOR_GREEN);
-                            draw_string(10, 40, tbuf, COLOR_WHITE);
-                            draw_string(10, 70, r_cont, COLOR_WHITE);
-                            draw_string(10, 90, r_date, COLOR_YELLOW);
-                            shown_hour = shown_min = -1;
-                            shown_y = shown_m = shown_d = -1;
-                            alarm_screen_visible = true;
-    						// xTaskCreatePinnedToCore(send_email, "mail_alarm_due", 4096, NULL, 4, NULL, 0);
-							if (mail_task == NULL) {
-    							xTaskCreatePinnedToCore(send_email, "mail_alarm_due", 12288, NULL, 2, &mail_task, 1);
-							}
+            if (time_synced) dsleep_scheduler_ready();
+            // Also rescan when the clock was set back past the last scan.
+            if (time_synced && (now >= next_scan || now < next_scan - 120)) {
+                time_t minute_start = now - timeinfo.tm_sec;
+                time_t until = minute_start + 60;
+                DueEntry due[MAX_REMINDERS];
+                int n_due, rung = 0;
+                xSemaphoreTake(reminders_mutex, portMAX_DELAY);
+                time_t wm = due_index_watermark_locked();
+                if (wm <= 0 || wm > until) due_index_set_watermark_locked(minute_start);
+                else if (wm < until - CONFIG_REMINDERS_CATCHUP_MAX_S) due_index_set_watermark_locked(until - CONFIG_REMINDERS_CATCHUP_MAX_S);
+                while ((n_due = due_index_take_locked(until, due, MAX_REMINDERS)) > 0) {
+                    for (int k = 0; k < n_due; k++) {
+                        int i = reminder_index_by_id_locked(due[k].id);
+                        if (i < 0) continue;
+                        if (minute_start - due[k].at > CONFIG_REMINDERS_CATCHUP_GRACE_S) {
+                            ESP_LOGW(TAG, "Bo qua nhac nho ID %d da lo (%ld s truoc)", due[k].id, (long)(minute_start - due[k].at));
+                            continue;
                         }
-                        taskYIELD();
-                        alarm_active = true;
-                        alarm_index  = idx;
-                        time(&alarm_started_at);
-                        first_swipe_ts = 0;
-                        snooze_index = -1; snooze_until = 0;
-                        xEventGroupSetBits(eg_alarm, EV_ALARM_START);  
-                        xEventGroupWaitBits(eg_alarm, EV_GESTURE_DONE, pdTRUE, pdTRUE, portMAX_DELAY);
-                        break;                             
+                        bool is_rep = (reminders[i].status == REM_STATUS_REPEAT);
+                        send_reminder_history(reminder_content(&reminders[i]));
+                        snooze_cancel(due[k].id);
+                        alarm_queue_push(due[k].id, is_rep ? ALARM_PRIO_REPEAT : ALARM_PRIO_ONESHOT, (int64_t)due[k].at * 1000000);
+                        rung++;
                     }
                 }
-                if (took && !released) xSemaphoreGive(reminders_mutex); 
+                xSemaphoreGive(reminders_mutex);
+                next_scan = until;
+                if (rung > 0 || until - wm_saved >= CONFIG_REMINDERS_WATERMARK_SAVE_S || until < wm_saved) {
+                    due_index_save_watermark(until);
+                    wm_saved = until;
+                }
             }
-		if (!alarm_active && snooze_index >= 0) {
-    		time_t nowt; time(&nowt);
-    		if (nowt >= snooze_until) {
-        	Reminder rr;
-        	if (reminders_mutex) xSemaphoreTake(reminders_mutex, portMAX_DELAY);
-        	rr = reminders[snooze_index];
-        	if (reminders_mutex) xSemaphoreGive(reminders_mutex);
-        	char tb[6]; fmt_time(timeinfo.tm_hour, timeinfo.tm_min, tb);
-        	if (ui_state == UI_IDLE) {
-            	fill_screen(COLOR_BLACK);
-            	// gpio_set_level(LDR_BUZZER_PIN, 1);
-            	draw_string(10, 10, "NHAC NHO:", COLOR_GREEN);
-            	draw_string(10, 40, tb, COLOR_WHITE);
-            	draw_string(10, 70, rr.content, COLOR_WHITE);
-            	draw_string(10, 90, rr.date, COLOR_YELLOW);
-                shown_hour = shown_min = -1;
-                shown_y = shown_m = shown_d = -1;
-                alarm_screen_visible = true;
-        	}
-            taskYIELD(); 
-        	alarm_active = true;
-        	alarm_index  = snooze_index;
-            time(&alarm_started_at);
-            first_swipe_ts = 0;
-            xEventGroupSetBits(eg_alarm, EV_ALARM_START);
-            xEventGroupWaitBits(eg_alarm, EV_GESTURE_DONE, pdTRUE, pdTRUE, portMAX_DELAY);
-    		}
-		}
         if (ui_state == UI_IDLE && !alarm_screen_visible) {
+            EventBits_t ev = xEventGroupClearBits(timesvc_events, TIMESVC_EV_ALL);
             if (shown_hour == -1 || shown_min == -1 || shown_y==-1) {
                 fill_screen(COLOR_BLACK);
                 const char *title = "THOI GIAN HIEN TAI";
@@ -315,25 +421,26 @@ void print_time_task(void *pvParam) {
                 shown_hour = timeinfo.tm_hour;
                 shown_min  = timeinfo.tm_min;
                 shown_y = cy; shown_m = cm; shown_d = cd;
-                idle_draw_upcoming(&timeinfo);
+                shown_version = reminders_version();
+                idle_draw_upcoming(now);
             } else {
-                if (timeinfo.tm_hour != shown_hour) {
+                if (ev & TIMESVC_EV_HOUR) {
                     char hh[3] = { (char)('0'+(timeinfo.tm_hour/10)), (char)('0'+(timeinfo.tm_hour%10)), 0 };
                     fill_rect(idle_x, idle_y, 2 * FONT_W, FONT_H, COLOR_BLACK);
                     draw_string(idle_x, idle_y, hh, COLOR_WHITE);
                     shown_hour = timeinfo.tm_hour;
-                    idle_draw_upcoming(&timeinfo);
+                    idle_draw_upcoming(now);
                 }
-                if (timeinfo.tm_min != shown_min) {
+                if (ev & TIMESVC_EV_MINUTE) {
                     char mm[3] = { (char)('0'+(timeinfo.tm_min/10)), (char)('0'+(timeinfo.tm_min%10)), 0 };
                     int mx = idle_x + 3 * FONT_W;
                     fill_rect(mx, idle_y, 2 * FONT_W, FONT_H, COLOR_BLACK);
                     draw_string(mx, idle_y, mm, COLOR_WHITE);
                     shown_min = timeinfo.tm_min;
-                    idle_draw_upcoming(&timeinfo);
+                    idle_draw_upcoming(now);
                 }
-                int cy = timeinfo.tm_year + 1900, cm = timeinfo.tm_mon + 1, cd = timeinfo.tm_mday;
-                if (cy!=shown_y || cm!=shown_m || cd!=shown_d) {
+                if (ev & TIMESVC_EV_DAY) {
+                    int cy = timeinfo.tm_year + 1900, cm = timeinfo.tm_mon + 1, cd = timeinfo.tm_mday;
                     char datebuf[11];
                     fmt_date(cy, cm, cd, datebuf);
                     int dx = (TFT_WIDTH - (int)strlen(datebuf)*FONT_W)/2;
@@ -341,290 +448,245 @@ void print_time_task(void *pvParam) {
                     draw_string(dx, idle_y + FONT_H + 6, datebuf, COLOR_YELLOW);
                     shown_y = cy; shown_m = cm; shown_d = cd;
                 }
+                uint32_t ver = reminders_version();
+                if (ver != shown_version) {
+                    shown_version = ver;
+                    idle_draw_upcoming(now);
+                }
             }
         } else {
             shown_hour = shown_min = -1;
             shown_y = shown_m = shown_d = -1;
         }
-        vTaskDelayUntil(&pt_last, pdMS_TO_TICKS(100));
+        if (!time_synced) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+        } else {
+#if CONFIG_REMINDERS_DEEP_SLEEP
+            maybe_go_online(vclock_now());
+            maybe_deep_sleep(vclock_now());
+#endif
+            time_t t = vclock_now();
+            time_t wake = sched_next_wake(t);
+            // Something due that the last scan could not see (added for the
+            // current minute): rescan now instead of spinning to the minute end.
+            if (wake <= t && next_scan != 0) next_scan = 0;
+            else sched_sleep_until(wake > t ? wake : t + 1);
+        }
     }
 }
 
+static void r_menu(void)         { ui_draw_menu(); }
+static void r_view_list(void)    { ui_draw_list_content("DANH SACH LICH"); }
+static void r_view_detail(void)  { ui_draw_view_detail(); }
+static void r_edit_pick(void)    { ui_draw_list_content("CHON LICH CAN CHINH"); }
+static void r_edit_submenu(void) { ui_draw_edit_submenu(); }
+static void r_edit_content(void) { ui_draw_preset_list("CHON NOI DUNG MOI"); }
+static void r_edit_date(void)    { ui_draw_date_editor("CHINH NGAY", edit_day, edit_month, two_sel); }
+static void r_edit_time(void)    { ui_draw_time_editor("CHINH GIO", edit_hour, edit_min, field_sel, true); }
+static void r_add_content(void)  { ui_draw_preset_list("CHON NOI DUNG"); }
+static void r_add_date(void)     { ui_draw_date_editor("CHON NGAY THANG", edit_day, edit_month, two_sel); }
+static void r_add_time(void)     { ui_draw_time_editor("CHON GIO", edit_hour, edit_min, field_sel, false); }
+static void r_del_pick(void)     { ui_draw_list_content("XOA LICH"); }
+
+// Opening or closing the menu silences a ringing alarm; print_time_task
+// repaints the clock once shown_* is cleared.
+static void enter_idle(void) {
+    alarm_post_ack(ALARM_ACK_MENU);
+    shown_hour = shown_min = -1;
+    shown_y = shown_m = shown_d = -1;
+    sched_kick();
+}
+
+static void exit_idle(void) { alarm_post_ack(ALARM_ACK_MENU); }
+
+// Cancel out of an editor keeps the value but does not publish it.
+static void exit_edit_date(void) {
+    submit_edit(STORE_F_DAY, (uint16_t)days_from_civil(edit_year, edit_month, edit_day), 0, 0, NULL, false);
+}
+
+static void exit_edit_time(void) { submit_edit(STORE_F_TIME, 0, edit_hour, edit_min, NULL, false); }
+
+static const int MENU_ITEMS = 4, SUBMENU_ITEMS = 3;
+
+static const UiScreen UI_SCREENS[UI_STATE_COUNT] = {
+    [UI_IDLE]         = { .enter = enter_idle, .exit = exit_idle },
+    [UI_MENU]         = { .render = r_menu, .cursor = &menu_index, .count = &MENU_ITEMS },
+    [UI_VIEW_LIST]    = { .render = r_view_list, .cursor = &pick_index, .count = &num_reminders },
+    [UI_VIEW_DETAIL]  = { .render = r_view_detail },
+    [UI_EDIT_PICK]    = { .render = r_edit_pick, .cursor = &pick_index, .count = &num_reminders },
+    [UI_EDIT_SUBMENU] = { .render = r_edit_submenu, .cursor = &submenu_index, .count = &SUBMENU_ITEMS },
+    [UI_EDIT_CONTENT] = { .render = r_edit_content, .cursor = &preset_index, .count = &NUM_CONTENT_PRESETS },
+    [UI_EDIT_DATE]    = { .render = r_edit_date, .exit = exit_edit_date },
+    [UI_EDIT_TIME]    = { .render = r_edit_time, .exit = exit_edit_time },
+    [UI_ADD_CONTENT]  = { .render = r_add_content, .cursor = &preset_index, .count = &NUM_CONTENT_PRESETS },
+    [UI_ADD_DATE]     = { .render = r_add_date },
+    [UI_ADD_TIME]     = { .render = r_add_time },
+    [UI_DEL_PICK]     = { .render = r_del_pick, .cursor = &pick_index, .count = &num_reminders },
+};
+
+static bool g_alarm(void)        { return alarm_active; }
+static bool g_edit_active(void)  { return edit_active; }
+static bool g_left(void)         { return two_sel == SEL_LEFT; }
+static bool g_hour(void)         { return field_sel == SEL_HOUR; }
+static bool g_last(void)         { return num_reminders <= 1; }
+static bool g_menu_empty(void)   { return menu_index != 2 && num_reminders == 0; }
+static bool g_menu_view(void)    { return menu_index == 0; }
+static bool g_menu_edit(void)    { return menu_index == 1; }
+static bool g_menu_add(void)     { return menu_index == 2; }
+static bool g_sub_content(void)  { return submenu_index == 0; }
+static bool g_sub_date(void)     { return submenu_index == 1; }
+
+static void a_ack_button(int n)  { alarm_post_ack(ALARM_ACK_BUTTON); }
+static void a_open_menu(int n)   { menu_index = 0; }
+static void a_pick_first(int n)  { pick_index = 0; }
+static void a_preset_first(int n){ preset_index = 0; }
+static void a_date_up(int n)     { step_date(n); }
+static void a_date_down(int n)   { step_date(-n); }
+static void a_time_up(int n)     { step_time(n); }
+static void a_time_down(int n)   { step_time(-n); }
+static void a_toggle_two(int n)  { two_sel = (two_sel == SEL_LEFT) ? SEL_RIGHT : SEL_LEFT; }
+static void a_toggle_field(int n){ field_sel = (field_sel == SEL_HOUR) ? SEL_MINUTE : SEL_HOUR; }
+static void a_select_right(int n){ two_sel = SEL_RIGHT; }
+static void a_select_min(int n)  { field_sel = SEL_MINUTE; }
+
+static void a_start_add(int n) {
+    preset_index = 0; two_sel = SEL_LEFT; edit_active = false;
+    TimeNow tn;
+    timesvc_read(&tn);
+    edit_year = tn.tm.tm_year + 1900;
+}
+
+static void a_load_picked(int n) {
+    xSemaphoreTake(reminders_mutex, portMAX_DELAY);
+    edit_hour = reminder_hour(&reminders[pick_index]);
+    edit_min  = reminder_min(&reminders[pick_index]);
+    civil_from_days(reminders[pick_index].day, &edit_year, &edit_month, &edit_day);
+    xSemaphoreGive(reminders_mutex);
+    submenu_index = 0; edit_active = false; two_sel = SEL_LEFT;
+}
+
+static void a_edit_date(int n) { two_sel = SEL_LEFT; edit_active = false; }
+static void a_edit_time(int n) { field_sel = SEL_HOUR; edit_active = false; }
+
+static void a_save_content(int n) {
+    submit_edit(STORE_F_CONTENT, 0, 0, 0, CONTENT_PRESETS[preset_index], true);
+}
+
+static void a_commit_date(int n) {
+    submit_edit(STORE_F_DAY, (uint16_t)days_from_civil(edit_year, edit_month, edit_day), 0, 0, NULL, true);
+    edit_active = !edit_active;
+}
+
+static void a_commit_time(int n) {
+    if (edit_active) submit_edit(STORE_F_TIME, 0, edit_hour, edit_min, NULL, true);
+    edit_active = !edit_active;
+}
+
+static void a_start_date(int n) { edit_day = 1; edit_month = 1; two_sel = SEL_LEFT; edit_active = false; }
+static void a_start_time(int n) { field_sel = SEL_HOUR; edit_hour = 0; edit_min = 0; }
+
+static void a_add(int n) {
+    char new_date[11];
+    fmt_date(edit_year, edit_month, edit_day, new_date);
+    add_reminder_full(-1, new_date, edit_hour, edit_min, CONTENT_PRESETS[preset_index], REM_STATUS_PENDING);
+}
+
+static void a_delete(int n) {
+    delete_reminder_at(pick_index);
+    if (pick_index >= num_reminders) pick_index = (num_reminders > 0) ? num_reminders - 1 : 0;
+}
+
+#define NAV(S) \
+    { S, BTN_NEXT, NULL, ui_fsm_prev, UI_STAY }, \
+    { S, BTN_BACK, NULL, ui_fsm_next, UI_STAY }
+
+static const UiTrans UI_ROWS[] = {
+    { UI_IDLE,         BTN_CANCEL, g_alarm,       a_ack_button,   UI_STAY },
+    { UI_IDLE,         BTN_OK,     NULL,          a_open_menu,    UI_MENU },
+
+    NAV(UI_MENU),
+    { UI_MENU,         BTN_OK,     g_menu_empty,  NULL,           UI_IDLE },
+    { UI_MENU,         BTN_OK,     g_menu_view,   a_pick_first,   UI_VIEW_LIST },
+    { UI_MENU,         BTN_OK,     g_menu_edit,   a_pick_first,   UI_EDIT_PICK },
+    { UI_MENU,         BTN_OK,     g_menu_add,    a_start_add,    UI_ADD_CONTENT },
+    { UI_MENU,         BTN_OK,     NULL,          a_pick_first,   UI_DEL_PICK },
+    { UI_MENU,         BTN_CANCEL, NULL,          NULL,           UI_IDLE },
+
+    NAV(UI_VIEW_LIST),
+    { UI_VIEW_LIST,    BTN_OK,     NULL,          NULL,           UI_VIEW_DETAIL },
+    { UI_VIEW_LIST,    BTN_CANCEL, NULL,          NULL,           UI_MENU },
+
+    { UI_VIEW_DETAIL,  BTN_OK,     NULL,          NULL,           UI_VIEW_LIST },
+    { UI_VIEW_DETAIL,  BTN_CANCEL, NULL,          NULL,           UI_VIEW_LIST },
+
+    NAV(UI_EDIT_PICK),
+    { UI_EDIT_PICK,    BTN_OK,     NULL,          a_load_picked,  UI_EDIT_SUBMENU },
+    { UI_EDIT_PICK,    BTN_CANCEL, NULL,          NULL,           UI_MENU },
+
+    NAV(UI_EDIT_SUBMENU),
+    { UI_EDIT_SUBMENU, BTN_OK,     g_sub_content, a_preset_first, UI_EDIT_CONTENT },
+    { UI_EDIT_SUBMENU, BTN_OK,     g_sub_date,    a_edit_date,    UI_EDIT_DATE },
+    { UI_EDIT_SUBMENU, BTN_OK,     NULL,          a_edit_time,    UI_EDIT_TIME },
+    { UI_EDIT_SUBMENU, BTN_CANCEL, NULL,          NULL,           UI_EDIT_PICK },
+
+    NAV(UI_EDIT_CONTENT),
+    { UI_EDIT_CONTENT, BTN_OK,     NULL,          a_save_content, UI_EDIT_SUBMENU },
+    { UI_EDIT_CONTENT, BTN_CANCEL, NULL,          NULL,           UI_EDIT_SUBMENU },
+
+    { UI_EDIT_DATE,    BTN_NEXT,   g_edit_active, a_date_up,      UI_STAY },
+    { UI_EDIT_DATE,    BTN_NEXT,   NULL,          a_toggle_two,   UI_STAY },
+    { UI_EDIT_DATE,    BTN_BACK,   g_edit_active, a_date_down,    UI_STAY },
+    { UI_EDIT_DATE,    BTN_BACK,   NULL,          a_toggle_two,   UI_STAY },
+    { UI_EDIT_DATE,    BTN_OK,     NULL,          a_commit_date,  UI_STAY },
+    { UI_EDIT_DATE,    BTN_CANCEL, NULL,          NULL,           UI_EDIT_SUBMENU },
+
+    { UI_EDIT_TIME,    BTN_NEXT,   g_edit_active, a_time_up,      UI_STAY },
+    { UI_EDIT_TIME,    BTN_NEXT,   NULL,          a_toggle_field, UI_STAY },
+    { UI_EDIT_TIME,    BTN_BACK,   g_edit_active, a_time_down,    UI_STAY },
+    { UI_EDIT_TIME,    BTN_BACK,   NULL,          a_toggle_field, UI_STAY },
+    { UI_EDIT_TIME,    BTN_OK,     NULL,          a_commit_time,  UI_STAY },
+    { UI_EDIT_TIME,    BTN_CANCEL, NULL,          NULL,           UI_EDIT_SUBMENU },
+
+    NAV(UI_ADD_CONTENT),
+    { UI_ADD_CONTENT,  BTN_OK,     NULL,          a_start_date,   UI_ADD_DATE },
+    { UI_ADD_CONTENT,  BTN_CANCEL, NULL,          NULL,           UI_MENU },
+
+    { UI_ADD_DATE,     BTN_NEXT,   NULL,          a_date_up,      UI_STAY },
+    { UI_ADD_DATE,     BTN_BACK,   NULL,          a_date_down,    UI_STAY },
+    { UI_ADD_DATE,     BTN_OK,     g_left,        a_select_right, UI_STAY },
+    { UI_ADD_DATE,     BTN_OK,     NULL,          a_start_time,   UI_ADD_TIME },
+    { UI_ADD_DATE,     BTN_CANCEL, NULL,          NULL,           UI_MENU },
+
+    { UI_ADD_TIME,     BTN_NEXT,   NULL,          a_time_up,      UI_STAY },
+    { UI_ADD_TIME,     BTN_BACK,   NULL,          a_time_down,    UI_STAY },
+    { UI_ADD_TIME,     BTN_OK,     g_hour,        a_select_min,   UI_STAY },
+    { UI_ADD_TIME,     BTN_OK,     NULL,          a_add,          UI_MENU },
+    { UI_ADD_TIME,     BTN_CANCEL, NULL,          NULL,           UI_MENU },
+
+    NAV(UI_DEL_PICK),
+    { UI_DEL_PICK,     BTN_OK,     g_last,        a_delete,       UI_MENU },
+    { UI_DEL_PICK,     BTN_OK,     NULL,          a_delete,       UI_STAY },
+    { UI_DEL_PICK,     BTN_CANCEL, NULL,          NULL,           UI_MENU },
+};
+
 void ui_task(void *pvParam) {
     ESP_LOGI(TAG, "UI task started");
     if (!reminders_mutex) reminders_mutex = xSemaphoreCreateMutex();
 	reminders_recalc();
     buttons_init();
+    ui_fsm_init(UI_ROWS, sizeof(UI_ROWS) / sizeof(UI_ROWS[0]), UI_SCREENS);
     ui_state = UI_IDLE;
-    TickType_t last = xTaskGetTickCount();
+    ui_last_input = xTaskGetTickCount();
     while (1) {
+        BtnEvent ev;
+        if (!buttons_get(&ev, portMAX_DELAY, editing_value())) continue;
+        ui_last_input = xTaskGetTickCount();
         BtnEdges e = {0};
-        scan_buttons(&e);
-        switch (ui_state) {
-        case UI_IDLE: {
-            if (alarm_active && e.cancel_edge) {
-                bool is_rep = false;
-                if (reminders_mutex) xSemaphoreTake(reminders_mutex, portMAX_DELAY);
-                if (alarm_index >= 0 && alarm_index < num_reminders) {
-                    is_rep = (strncasecmp(reminders[alarm_index].status, "repeat", 6) == 0);
-                }
-                if (reminders_mutex) xSemaphoreGive(reminders_mutex);
-                if (is_rep) {                 
-                    time_t nowt; time(&nowt);
-                    snooze_until = nowt + SNOOZE_SECS;
-                    snooze_index = alarm_index;
-                } else {
-                    snooze_index = -1;
-                }
-                alarm_active = false;
-                alarm_screen_visible = false;         
-                shown_hour = shown_min = -1;  
-                shown_y = shown_m = shown_d = -1;
-                gpio_set_level(LDR_BUZZER_PIN, 0);
-                draw_idle_screen_now();
-                time_t now; struct tm timeinfo;
-                time(&now); localtime_r(&now, &timeinfo);
-                shown_hour = timeinfo.tm_hour; shown_min = timeinfo.tm_min;
-                shown_y = timeinfo.tm_year+1900; shown_m = timeinfo.tm_mon+1; shown_d = timeinfo.tm_mday;
-                idle_draw_upcoming(&timeinfo);
-                xEventGroupSetBits(eg_alarm, EV_GESTURE_DONE);   
-                ldr_gl5537_set_enabled(&ldr, false);
-                break;                        
-            }
-            if (e.ok_edge) {
-                if (alarm_active) {                    
-                    alarm_active = false;  
-                    alarm_screen_visible = false;           
-                    shown_hour = shown_min = -1;       
-                    shown_y = shown_m = shown_d = -1;
-                    gpio_set_level(LDR_BUZZER_PIN, 0);
-                    draw_idle_screen_now();
-                    time_t now; struct tm timeinfo;
-                    time(&now); localtime_r(&now, &timeinfo);
-                    shown_hour = timeinfo.tm_hour; shown_min = timeinfo.tm_min;
-                    shown_y = timeinfo.tm_year+1900; shown_m = timeinfo.tm_mon+1; shown_d = timeinfo.tm_mday;
-                    idle_draw_upcoming(&timeinfo);
-                    xEventGroupSetBits(eg_alarm, EV_GESTURE_DONE);   
-                    ldr_gl5537_set_enabled(&ldr, false);
-                }
-                menu_index = 0;
-                SET_STATE(UI_MENU);
-                ui_draw_menu();
-            }
-            break;
-        }
-        break;
-        case UI_MENU:
-            if (e.next_edge) { if (menu_index>0) menu_index--; else menu_index=3; ui_draw_menu(); }
-            if (e.back_edge) { if (menu_index<3) menu_index++; else menu_index=0; ui_draw_menu(); }
-            if (e.ok_edge) {
-                if (menu_index == 0) { 
-                    if (num_reminders==0) { SET_STATE(UI_IDLE); shown_hour=shown_min=-1; break; }
-                    pick_index=0; SET_STATE(UI_VIEW_LIST); ui_draw_list_content("DANH SACH LICH");
-                } else if (menu_index == 1) { 
-                    if (num_reminders==0) { SET_STATE(UI_IDLE); shown_hour=shown_min=-1; break; }
-                    pick_index=0; SET_STATE(UI_EDIT_PICK); ui_draw_list_content("CHON LICH CAN CHINH");
-                } else if (menu_index == 2) { 
-                    preset_index=0; two_sel=SEL_LEFT; edit_active=false;
-                    time_t now; struct tm t; time(&now); localtime_r(&now,&t);
-                    edit_year = t.tm_year + 1900;
-                    SET_STATE(UI_ADD_CONTENT); ui_draw_preset_list("CHON NOI DUNG");
-                } else { 
-                    if (num_reminders==0) { SET_STATE(UI_IDLE); shown_hour=shown_min=-1; break; }
-                    pick_index=0; SET_STATE(UI_DEL_PICK); ui_draw_list_content("XOA LICH");
-                }
-            }
-            if (e.cancel_edge) { 
-                alarm_active = false; 
-                alarm_screen_visible = false;                     
-                SET_STATE(UI_IDLE); 
-                shown_hour=shown_min=-1; 
-                shown_y = shown_m = shown_d = -1; 
-                xEventGroupSetBits(eg_alarm, EV_GESTURE_DONE);  
-                ldr_gl5537_set_enabled(&ldr, false);         
-            }
-            break;   
-        case UI_VIEW_LIST:
-            if (e.next_edge) { if (pick_index>0) pick_index--; else pick_index=(num_reminders>0?num_reminders-1:0); ui_draw_list_content("DANH SACH LICH"); }
-            if (e.back_edge) { if (pick_index<num_reminders-1) pick_index++; else pick_index=0; ui_draw_list_content("DANH SACH LICH"); }
-            if (e.ok_edge)   { SET_STATE(UI_VIEW_DETAIL); ui_draw_view_detail(); }
-            if (e.cancel_edge){ SET_STATE(UI_MENU); ui_draw_menu(); }
-            break;
-        case UI_VIEW_DETAIL:
-            if (e.ok_edge || e.cancel_edge) {
-                SET_STATE(UI_VIEW_LIST);
-                ui_draw_list_content("DANH SACH LICH");
-            }
-            break;
-        case UI_EDIT_PICK:
-            if (e.next_edge) { if (pick_index>0) pick_index--; else pick_index=(num_reminders>0?num_reminders-1:0); ui_draw_list_content("CHON LICH CAN CHINH"); }
-            if (e.back_edge) { if (pick_index<num_reminders-1) pick_index++; else pick_index=0; ui_draw_list_content("CHON LICH CAN CHINH"); }
-            if (e.ok_edge) {
-                xSemaphoreTake(reminders_mutex, portMAX_DELAY);
-                edit_hour  = reminders[pick_index].hour;
-                edit_min   = reminders[pick_index].minute;
-                parse_date(reminders[pick_index].date, &edit_year, &edit_month, &edit_day);
-                xSemaphoreGive(reminders_mutex);
-                submenu_index = 0; edit_active=false; two_sel=SEL_LEFT;
-                SET_STATE(UI_EDIT_SUBMENU); ui_draw_edit_submenu();
-            }
-            if (e.cancel_edge){ SET_STATE(UI_MENU); ui_draw_menu(); }
-            break;
-        case UI_EDIT_SUBMENU:
-            if (e.next_edge) { if (submenu_index>0) submenu_index--; else submenu_index=2; ui_draw_edit_submenu(); }
-            if (e.back_edge) { if (submenu_index<2) submenu_index++; else submenu_index=0; ui_draw_edit_submenu(); }
-            if (e.ok_edge) {
-                if (submenu_index==0) { 
-                    preset_index=0;
-                    SET_STATE(UI_EDIT_CONTENT); ui_draw_preset_list("CHON NOI DUNG MOI");
-                } else if (submenu_index==1) { 
-                    two_sel=SEL_LEFT; edit_active=false;
-                    SET_STATE(UI_EDIT_DATE); ui_draw_date_editor("CHINH NGAY", edit_day, edit_month, two_sel);
-                } else { 
-                    field_sel=SEL_HOUR; edit_active=false;
-                    SET_STATE(UI_EDIT_TIME); ui_draw_time_editor("CHINH GIO", edit_hour, edit_min, field_sel, true);
-                }
-            }
-            if (e.cancel_edge){ SET_STATE(UI_EDIT_PICK); ui_draw_list_content("CHON LICH CAN CHINH"); }
-            break;
-        case UI_EDIT_CONTENT:
-            if (e.next_edge) { if (preset_index>0) preset_index--; else preset_index=NUM_CONTENT_PRESETS-1; ui_draw_preset_list("CHON NOI DUNG MOI"); }
-            if (e.back_edge) { if (preset_index<NUM_CONTENT_PRESETS-1) preset_index++; else preset_index=0; ui_draw_preset_list("CHON NOI DUNG MOI"); }
-            if (e.ok_edge) {
-                xSemaphoreTake(reminders_mutex, portMAX_DELAY);
-		        strncpy(reminders[pick_index].content, CONTENT_PRESETS[preset_index], sizeof(reminders[pick_index].content)-1);
-		        reminders[pick_index].content[sizeof(reminders[pick_index].content)-1] = 0;
-		        xSemaphoreGive(reminders_mutex);
-		        update_reminder(reminders[pick_index].id, reminders[pick_index].date, reminders[pick_index].hour, reminders[pick_index].minute, reminders[pick_index].content, reminders[pick_index].status);
-		        save_reminders_to_nvs();
-                SET_STATE(UI_EDIT_SUBMENU); ui_draw_edit_submenu();
-            }
-            if (e.cancel_edge){ SET_STATE(UI_EDIT_SUBMENU); ui_draw_edit_submenu(); }
-            break;
-        case UI_EDIT_DATE:
-            if (e.next_edge) {
-                if (!edit_active) { two_sel = (two_sel==SEL_LEFT)?SEL_RIGHT:SEL_LEFT; }
-                else { if (two_sel==SEL_LEFT) { edit_day++; } else { edit_month++; } clamp_day_month_y(&edit_day,&edit_month,edit_year); }
-                ui_draw_date_editor("CHINH NGAY", edit_day, edit_month, two_sel);
-            }
-            if (e.back_edge) {
-                if (!edit_active) { two_sel = (two_sel==SEL_LEFT)?SEL_RIGHT:SEL_LEFT; }
-                else { if (two_sel==SEL_LEFT) { edit_day--; } else { edit_month--; } clamp_day_month_y(&edit_day,&edit_month,edit_year); }
-                ui_draw_date_editor("CHINH NGAY", edit_day, edit_month, two_sel);
-            }
-            if (e.ok_edge) {
-                xSemaphoreTake(reminders_mutex, portMAX_DELAY);
-		        fmt_date(edit_year, edit_month, edit_day, reminders[pick_index].date);
-		        xSemaphoreGive(reminders_mutex);
-		        update_reminder(reminders[pick_index].id, reminders[pick_index].date, reminders[pick_index].hour, reminders[pick_index].minute, reminders[pick_index].content, reminders[pick_index].status);
-		        edit_active = !edit_active; 
-                save_reminders_to_nvs();
-		        ui_draw_date_editor("CHINH NGAY", edit_day, edit_month, two_sel);
-             }
-            if (e.cancel_edge) {
-                xSemaphoreTake(reminders_mutex, portMAX_DELAY);
-                fmt_date(edit_year, edit_month, edit_day, reminders[pick_index].date);
-                xSemaphoreGive(reminders_mutex);
-                SET_STATE(UI_EDIT_SUBMENU); ui_draw_edit_submenu();
-            }
-            break;
-        case UI_EDIT_TIME:
-            if (e.next_edge) {
-                if (!edit_active) { field_sel=(field_sel==SEL_HOUR)?SEL_MINUTE:SEL_HOUR; }
-                else { if (field_sel==SEL_HOUR) edit_hour++; else edit_min++; clamp_time(&edit_hour,&edit_min); }
-                ui_draw_time_editor("CHINH GIO", edit_hour, edit_min, field_sel, true);
-            }
-            if (e.back_edge) {
-                if (!edit_active) { field_sel=(field_sel==SEL_HOUR)?SEL_MINUTE:SEL_HOUR; }
-                else { if (field_sel==SEL_HOUR) edit_hour--; else edit_min--; clamp_time(&edit_hour,&edit_min); }
-                ui_draw_time_editor("CHINH GIO", edit_hour, edit_min, field_sel, true);
-            }
-            if (e.ok_edge) {
-                if (edit_active) {
-                    xSemaphoreTake(reminders_mutex, portMAX_DELAY);
-		            if (field_sel==SEL_HOUR) reminders[pick_index].hour=edit_hour; else reminders[pick_index].minute=edit_min;
-		            xSemaphoreGive(reminders_mutex);
-		            update_reminder(reminders[pick_index].id, reminders[pick_index].date, reminders[pick_index].hour, reminders[pick_index].minute, reminders[pick_index].content, reminders[pick_index].status);
-                    save_reminders_to_nvs();
-                }
-                edit_active=!edit_active;
-                ui_draw_time_editor("CHINH GIO", edit_hour, edit_min, field_sel, true);
-            }
-            if (e.cancel_edge) {
-                xSemaphoreTake(reminders_mutex, portMAX_DELAY);
-                reminders[pick_index].hour=edit_hour; reminders[pick_index].minute=edit_min;
-                
-                xSemaphoreGive(reminders_mutex);
-                SET_STATE(UI_EDIT_SUBMENU); ui_draw_edit_submenu();
-            }
-            break;
-        case UI_ADD_CONTENT:
-            if (e.next_edge) { if (preset_index>0) preset_index--; else preset_index=NUM_CONTENT_PRESETS-1; ui_draw_preset_list("CHON NOI DUNG"); }
-            if (e.back_edge) { if (preset_index<NUM_CONTENT_PRESETS-1) preset_index++; else preset_index=0; ui_draw_preset_list("CHON NOI DUNG"); }
-            if (e.ok_edge) {
-                edit_day=1; edit_month=1; two_sel=SEL_LEFT; edit_active=false;
-                SET_STATE(UI_ADD_DATE); ui_draw_date_editor("CHON NGAY THANG", edit_day, edit_month, two_sel);
-            }
-            if (e.cancel_edge){ SET_STATE(UI_MENU); ui_draw_menu(); }
-            break;
-        case UI_ADD_DATE:
-            if (e.next_edge) {
-                if (two_sel==SEL_LEFT) { edit_day++; } else { edit_month++; }
-                clamp_day_month_y(&edit_day,&edit_month,edit_year);
-                ui_draw_date_editor("CHON NGAY THANG", edit_day, edit_month, two_sel);
-            }
-            if (e.back_edge) {
-                if (two_sel==SEL_LEFT) { edit_day--; } else { edit_month--; }
-                clamp_day_month_y(&edit_day,&edit_month,edit_year);
-                ui_draw_date_editor("CHON NGAY THANG", edit_day, edit_month, two_sel);
-            }
-            if (e.ok_edge) {
-                if (two_sel==SEL_LEFT) {
-                    two_sel = SEL_RIGHT; 
-                    ui_draw_date_editor("CHON NGAY THANG", edit_day, edit_month, two_sel);
-                } else {
-                    field_sel = SEL_HOUR; edit_hour=0; edit_min=0;
-                    SET_STATE(UI_ADD_TIME); ui_draw_time_editor("CHON GIO", edit_hour, edit_min, field_sel, false);
-                }
-            }
-            if (e.cancel_edge){ SET_STATE(UI_MENU); ui_draw_menu(); }
-            break;
-        case UI_ADD_TIME:
-            if (e.next_edge) {
-                if (field_sel==SEL_HOUR) { edit_hour++; } else { edit_min++; }
-                clamp_time(&edit_hour,&edit_min);
-                ui_draw_time_editor("CHON GIO", edit_hour, edit_min, field_sel, false);
-            }
-            if (e.back_edge) {
-                if (field_sel==SEL_HOUR) { edit_hour--; } else { edit_min--; }
-                clamp_time(&edit_hour,&edit_min);
-                ui_draw_time_editor("CHON GIO", edit_hour, edit_min, field_sel, false);
-            }
-            if (e.ok_edge) {
-                if (field_sel==SEL_HOUR) {
-                field_sel=SEL_MINUTE; 
-                ui_draw_time_editor("CHON GIO", edit_hour, edit_min, field_sel, false);
-                } else {
-                    char new_date[11]; fmt_date(edit_year, edit_month, edit_day, new_date);
-					add_reminder_full(next_id, new_date, edit_hour, edit_min, CONTENT_PRESETS[preset_index], "pending");
-                    save_reminders_to_nvs();
-                    SET_STATE(UI_MENU); ui_draw_menu();
-                }
-            }
-            if (e.cancel_edge){ SET_STATE(UI_MENU); ui_draw_menu(); }
-            break;
-        case UI_DEL_PICK:
-            if (e.next_edge) { if (pick_index>0) pick_index--; else pick_index=(num_reminders>0?num_reminders-1:0); ui_draw_list_content("XOA LICH"); }
-            if (e.back_edge) { if (pick_index<num_reminders-1) pick_index++; else pick_index=0; ui_draw_list_content("XOA LICH"); }
-            if (e.ok_edge) {
-                delete_reminder_at(pick_index);
-                save_reminders_to_nvs();
-                if (num_reminders==0) { SET_STATE(UI_MENU); ui_draw_menu(); }
-                else { if (pick_index>=num_reminders) pick_index=num_reminders-1; ui_draw_list_content("XOA LICH"); }
-            }
-            if (e.cancel_edge){ SET_STATE(UI_MENU); ui_draw_menu(); }
-            break;
-        }
-        vTaskDelayUntil(&last, pdMS_TO_TICKS(20));
+        buttons_edges(&ev, &e);
+        int n = e.ok_edge + e.back_edge + e.next_edge + e.cancel_edge;
+        UiState from = ui_state;
+        ui_trace_begin();
+        if (n && ui_fsm_dispatch((BtnId)ev.btn, n)) latency_note_ui(from, esp_timer_get_time() - ev.t_us);
+        ui_trace_end(&ev);
     }
 }
@@ -0,0 +1,81 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_log.h"
+#include "civil_time.h"
+#include "vclock.h"
+#include "scheduler.h"
+#include "timer_wheel.h"
+#include "time_service.h"
+
+#define TAG "TimeSvc"
+
+EventGroupHandle_t timesvc_events = NULL;
+
+static TimeNow ts_cur;
+static uint32_t ts_seq = 0;     // odd while ts_cur is being written
+static portMUX_TYPE ts_lock = portMUX_INITIALIZER_UNLOCKED;
+static TwTimer ts_timer;
+
+static void fill(TimeNow *t, time_t now) {
+    t->now = now;
+    t->day = civil_local_day(now);
+    t->min_of_day = civil_local_min_of_day(now);
+    civil_localtime(now, &t->tm);
+}
+
+void timesvc_refresh(void) {
+    TimeNow next;
+    fill(&next, vclock_now());
+    portENTER_CRITICAL(&ts_lock);
+    TimeNow prev = ts_cur;
+    bool first = (ts_seq == 0);
+    __atomic_store_n(&ts_seq, ts_seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    ts_cur = next;
+    __atomic_store_n(&ts_seq, ts_seq + 1, __ATOMIC_RELEASE);
+    portEXIT_CRITICAL(&ts_lock);
+    EventBits_t ev = 0;
+    if (first || next.day != prev.day) ev |= TIMESVC_EV_DAY | TIMESVC_EV_HOUR | TIMESVC_EV_MINUTE;
+    else if (next.tm.tm_hour != prev.tm.tm_hour) ev |= TIMESVC_EV_HOUR | TIMESVC_EV_MINUTE;
+    else if (next.min_of_day != prev.min_of_day) ev |= TIMESVC_EV_MINUTE;
+    if (ev && timesvc_events) {
+        xEventGroupSetBits(timesvc_events, ev);
+        sched_kick();
+    }
+}
+
+// A reader that gets in ahead of the tick refreshes the cache itself, so
+// callers never see a second that has already passed.
+void timesvc_read(TimeNow *out) {
+    time_t now = vclock_now();
+    for (;;) {
+        uint32_t seq = __atomic_load_n(&ts_seq, __ATOMIC_ACQUIRE);
+        if (!(seq & 1)) {
+            memcpy(out, &ts_cur, sizeof(*out));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&ts_seq, __ATOMIC_RELAXED) == seq) {
+                if (seq != 0 && out->now >= now) return;
+                timesvc_refresh();
+                continue;
+            }
+        }
+        taskYIELD();
+    }
+}
+
+// Rollovers only happen on minute boundaries, so the tick sleeps until
+// the next one; reads in between refresh the cache on demand.
+static void ts_tick(TwTimer *t, void *arg) {
+    timesvc_refresh();
+    tw_arm(t, 60 - civil_local_sec_of_day(vclock_now()) % 60);
+}
+
+void timesvc_start(void) {
+    if (timesvc_events) return;
+    timesvc_events = xEventGroupCreate();
+    tw_init_timer(&ts_timer, ts_tick, NULL);
+    ts_tick(&ts_timer, NULL);
+    ESP_LOGI(TAG, "Time service started");
+}
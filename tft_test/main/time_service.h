@@ -0,0 +1,28 @@
+#pragma once
+#include <stdint.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+// Local time computed at most once per second (and after every clock step)
+// and published for lock-free reads; a timer-wheel tick at each minute
+// boundary delivers rollovers even when nobody is reading. Rollovers set bits in timesvc_events,
+// and a minute rollover also kicks the scheduler; consumers clear the
+// bits they handle rather than comparing fields themselves.
+#define TIMESVC_EV_MINUTE (1 << 0)
+#define TIMESVC_EV_HOUR   (1 << 1)
+#define TIMESVC_EV_DAY    (1 << 2)
+#define TIMESVC_EV_ALL    (TIMESVC_EV_MINUTE | TIMESVC_EV_HOUR | TIMESVC_EV_DAY)
+
+typedef struct {
+    time_t    now;
+    int32_t   day;          // local days since 1970-01-01
+    int       min_of_day;
+    struct tm tm;
+} TimeNow;
+
+extern EventGroupHandle_t timesvc_events;
+
+void timesvc_start(void);
+void timesvc_refresh(void);
+void timesvc_read(TimeNow *out);
@@ -1,4 +1,7 @@
+#include <stdbool.h>
+#include <stdint.h>
 #include "display.h"
+#include "civil_time.h"
 
 int clock_x = 0, clock_y = 0;
 
@@ -50,21 +53,13 @@ void clock_draw_minutes(int m) {
     draw_string(x, clock_y, mm, COLOR_WHITE);
 }
 
-static inline int days_in_month(int year, int month) {
-    static const int dm[12] = {31,28,31,30,31,30,31,31,30,31,30,31};
-    int d = dm[(month-1+12)%12];
-    int leap = ((year%4==0) && (year%100!=0)) || (year%400==0);
-    if (month == 2 && leap) d = 29;
-    return d;
-}
-
 void clamp_day_month_y(int* day, int* month, int year) {
     if (*month < 1) {
         *month = 12;
     } else if (*month > 12) {
         *month = 1;
     }
-    int maxd = days_in_month(year, *month);
+    int maxd = civil_days_in_month(year, *month);
     if (*day < 1) {
         *day = maxd;
     } else if (*day > maxd) {
@@ -77,4 +72,23 @@ void clamp_time(int *h, int *m) {
     if (*h > 23) *h = 0;
     if (*m < 0)  *m = 59;
     if (*m > 59) *m = 0;
+}
+
+// v + delta wrapped into [lo, hi], for editors stepping several at once.
+int wrap_step(int v, int delta, int lo, int hi) {
+    int span = hi - lo + 1;
+    int r = (v - lo + delta) % span;
+    return lo + (r < 0 ? r + span : r);
+}
+
+bool parse_date_checked(const char *s, int *y, int *m, int *d) {
+    if (!s) return false;
+    for (int i = 0; i < 10; i++) {
+        if (i == 4 || i == 7) { if (s[i] != '-') return false; }
+        else if (s[i] < '0' || s[i] > '9') return false;
+    }
+    if (s[10] != '\0') return false;
+    parse_date(s, y, m, d);
+    if (*y < 1970 || *y > 2149 || *m < 1 || *m > 12) return false;
+    return *d >= 1 && *d <= civil_days_in_month(*y, *m);
 }
\ No newline at end of file
@@ -1,5 +1,8 @@
 #pragma once
+#include <stdbool.h>
+#include <stdint.h>
 #include "display.h"
+#include "civil_time.h"
 
 extern int clock_x, clock_y;
 
@@ -11,4 +14,6 @@ void clock_draw_full(int h, int m);
 void clock_draw_hours(int h);
 void clock_draw_minutes(int m);
 void clamp_day_month_y(int* day, int* month, int year);
-void clamp_time(int *h, int *m);
\ No newline at end of file
+void clamp_time(int *h, int *m);
+int  wrap_step(int v, int delta, int lo, int hi);
+bool parse_date_checked(const char *s, int *y, int *m, int *d);
\ No newline at end of file
@@ -0,0 +1,151 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "timer_wheel.h"
+#include "vclock.h"
+
+#define TAG "TimerWheel"
+#define TW_BITS   6
+#define TW_SIZE   (1u << TW_BITS)
+#define TW_MASK   (TW_SIZE - 1)
+#define TW_LEVELS 3
+#define TW_RANGE  (1u << (TW_BITS * TW_LEVELS))
+
+static TwTimer *wheel[TW_LEVELS][TW_SIZE];
+static uint32_t tw_now = 0;     // last tick processed
+static int tw_count = 0;
+static bool tw_ticking = false;  // callbacks re-arming must not tick again
+static SemaphoreHandle_t tw_mutex = NULL;
+static TaskHandle_t tw_task = NULL;
+
+static uint32_t mono_secs(void) {
+    return (uint32_t)(vclock_mono_us() / 1000000);
+}
+
+static void unlink_timer(TwTimer *t) {
+    *t->pprev = t->next;
+    if (t->next) t->next->pprev = t->pprev;
+    t->next = NULL;
+    t->pprev = NULL;
+    tw_count--;
+}
+
+// The level-n slot is taken from the expiry itself, so its cascade comes
+// up no later than the timer is due.
+static void place(TwTimer *t) {
+    uint32_t delta = t->expires - tw_now;
+    uint32_t at = t->expires;
+    int lvl = 0;
+    if ((int32_t)delta < 0) {
+        at = tw_now;
+    } else if (delta >= TW_RANGE) {
+        at = tw_now + TW_RANGE - 1;
+        lvl = TW_LEVELS - 1;
+    } else {
+        while (lvl < TW_LEVELS - 1 && delta >= (TW_SIZE << (TW_BITS * lvl))) lvl++;
+    }
+    TwTimer **head = &wheel[lvl][(at >> (TW_BITS * lvl)) & TW_MASK];
+    t->next = *head;
+    if (t->next) t->next->pprev = &t->next;
+    t->pprev = head;
+    *head = t;
+    tw_count++;
+}
+
+static void cascade(int lvl) {
+    TwTimer **head = &wheel[lvl][(tw_now >> (TW_BITS * lvl)) & TW_MASK];
+    TwTimer *t = *head;
+    *head = NULL;
+    while (t) {
+        TwTimer *next = t->next;
+        tw_count--;
+        place(t);
+        t = next;
+    }
+}
+
+static void tick_locked(void) {
+    tw_now++;
+    for (int lvl = 1; lvl < TW_LEVELS && (tw_now & ((1u << (TW_BITS * lvl)) - 1)) == 0; lvl++) {
+        cascade(lvl);
+    }
+    TwTimer **head = &wheel[0][tw_now & TW_MASK];
+    while (*head) {
+        TwTimer *t = *head;
+        unlink_timer(t);
+        if ((int32_t)(t->expires - tw_now) > 0) place(t);   // clamped long delay
+        else t->cb(t, t->arg);
+    }
+}
+
+// An empty wheel may jump; otherwise the task never lags by more than one
+// cascade period, so stepping tick by tick stays cheap.
+static void catch_up_locked(void) {
+    if (tw_ticking) return;
+    uint32_t now = mono_secs();
+    if (tw_count == 0) tw_now = now;
+    tw_ticking = true;
+    while ((int32_t)(now - tw_now) > 0) tick_locked();
+    tw_ticking = false;
+}
+
+// Next tick worth waking for: a due level-0 slot or the next cascade.
+static uint32_t next_event_locked(void) {
+    uint32_t limit = (tw_now | TW_MASK) + 1;
+    for (uint32_t at = tw_now + 1; at < limit; at++) {
+        if (wheel[0][at & TW_MASK]) return at;
+    }
+    return limit;
+}
+
+static void tw_task_fn(void *pv) {
+    for (;;) {
+        xSemaphoreTakeRecursive(tw_mutex, portMAX_DELAY);
+        catch_up_locked();
+        uint32_t wake = tw_count ? next_event_locked() : 0;
+        xSemaphoreGiveRecursive(tw_mutex);
+        int64_t us = wake ? (int64_t)wake * 1000000 - vclock_mono_us() : -1;
+        if (us < 0 && wake) continue;
+        ulTaskNotifyTake(pdTRUE, wake ? vclock_ticks(us) : portMAX_DELAY);
+    }
+}
+
+void tw_start(void) {
+    if (tw_task) return;
+    tw_mutex = xSemaphoreCreateRecursiveMutex();
+    tw_now = mono_secs();
+    xTaskCreatePinnedToCore(tw_task_fn, "twheel", 3072, NULL, 7, &tw_task, 0);
+    ESP_LOGI(TAG, "Timer wheel started at %u s", (unsigned)tw_now);
+}
+
+void tw_init_timer(TwTimer *t, tw_cb_t cb, void *arg) {
+    memset(t, 0, sizeof(*t));
+    t->cb = cb;
+    t->arg = arg;
+}
+
+void tw_arm(TwTimer *t, uint32_t delay_s) {
+    xSemaphoreTakeRecursive(tw_mutex, portMAX_DELAY);
+    if (t->pprev) unlink_timer(t);
+    catch_up_locked();
+    t->expires = tw_now + (delay_s ? delay_s : 1);
+    place(t);
+    xSemaphoreGiveRecursive(tw_mutex);
+    if (tw_task) xTaskNotifyGive(tw_task);
+}
+
+void tw_cancel(TwTimer *t) {
+    xSemaphoreTakeRecursive(tw_mutex, portMAX_DELAY);
+    if (t->pprev) unlink_timer(t);
+    xSemaphoreGiveRecursive(tw_mutex);
+}
+
+void tw_kick(void) {
+    if (tw_task) xTaskNotifyGive(tw_task);
+}
+
+bool tw_pending(const TwTimer *t) {
+    return t->pprev != NULL;
+}
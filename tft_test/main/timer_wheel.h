@@ -0,0 +1,26 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+// Hierarchical timing wheel for relative timeouts (snoozes, gesture
+// timeouts, retries): 1 s ticks of the monotonic clock, three 64-slot
+// levels (~3 days); longer delays are re-placed when their slot comes up.
+// Arm and cancel are O(1). Callbacks run on the wheel task with the wheel
+// lock held: keep them short, they may re-arm or cancel timers.
+typedef struct TwTimer TwTimer;
+typedef void (*tw_cb_t)(TwTimer *t, void *arg);
+
+struct TwTimer {
+    TwTimer  *next;
+    TwTimer **pprev;      // NULL when not armed
+    uint32_t  expires;    // wheel tick
+    tw_cb_t   cb;
+    void     *arg;
+};
+
+void tw_start(void);
+void tw_init_timer(TwTimer *t, tw_cb_t cb, void *arg);
+void tw_arm(TwTimer *t, uint32_t delay_s);
+void tw_cancel(TwTimer *t);
+bool tw_pending(const TwTimer *t);
+void tw_kick(void);   // re-plan the wheel task's sleep after a clock change
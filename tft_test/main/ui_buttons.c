@@ -1,23 +1,57 @@
-#define BTN_OK_PIN     7
-#define BTN_BACK_PIN   16
-#define BTN_NEXT_PIN   15
-#define BTN_CANCEL_PIN 6
+#include <stdint.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
 #include "driver/gpio.h"
 #include "esp_err.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "ui_buttons.h"
+
+typedef struct {
+    uint8_t idx;
+    uint8_t down;
+    uint8_t synth;       // injected event: type and count, no debouncing
+    uint8_t type;
+    uint16_t count;
+    int64_t t_us;
+} RawEdge;
 
 typedef struct {
     gpio_num_t pin;
-    int stable;    
-    int last_raw;  
-    TickType_t tstamp;
-} DebBtn;
+    bool    down;        // debounced state
+    bool    long_sent;
+    int64_t t_accept;    // last accepted edge
+    int64_t settle_at;   // resample once the lockout ends, 0 = none
+    int64_t next_repeat;
+    uint16_t repeats;
+} Btn;
+
+#define BTN_REPEAT_MASK ((1u << BTN_NEXT) | (1u << BTN_BACK))
 
-static DebBtn db_ok    = {BTN_OK_PIN, 0, 1, 0};
-static DebBtn db_back  = {BTN_BACK_PIN, 0, 1, 0};
-static DebBtn db_next  = {BTN_NEXT_PIN, 0, 1, 0};
-static DebBtn db_cancel= {BTN_CANCEL_PIN, 0, 1, 0};
+static Btn btns[BTN_COUNT] = {
+    [BTN_OK]     = { .pin = BTN_OK_PIN },
+    [BTN_BACK]   = { .pin = BTN_BACK_PIN },
+    [BTN_NEXT]   = { .pin = BTN_NEXT_PIN },
+    [BTN_CANCEL] = { .pin = BTN_CANCEL_PIN },
+};
+static QueueHandle_t raw_q = NULL;
+static volatile uint32_t lost_mask = 0;   // buttons whose edge raw_q dropped
+
+// Level interrupts (which double as light-sleep wake sources) flipped to
+// the opposite level on every hit give one interrupt per edge, no storm
+// while a button is held.
+static void IRAM_ATTR btn_isr(void *arg) {
+    int idx = (int)(intptr_t)arg;
+    RawEdge r = { .idx = (uint8_t)idx, .t_us = esp_timer_get_time() };
+    r.down = !gpio_get_level(btns[idx].pin);
+    gpio_set_intr_type(btns[idx].pin, r.down ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL);
+    BaseType_t woken = pdFALSE;
+    // The polarity is already flipped, so a dropped edge would not come
+    // again: have buttons_get resample the pin instead.
+    if (xQueueSendFromISR(raw_q, &r, &woken) != pdTRUE) __atomic_fetch_or(&lost_mask, 1u << idx, __ATOMIC_RELAXED);
+    portYIELD_FROM_ISR(woken);
+}
 
 void buttons_init(void) {
     gpio_config_t io = {
@@ -25,43 +59,120 @@ void buttons_init(void) {
         .mode = GPIO_MODE_INPUT,
         .pull_up_en = GPIO_PULLUP_ENABLE,
         .pull_down_en = GPIO_PULLDOWN_DISABLE,
-        .intr_type = GPIO_INTR_DISABLE
+        .intr_type = GPIO_INTR_LOW_LEVEL
     };
+    raw_q = xQueueCreate(32, sizeof(RawEdge));
     ESP_ERROR_CHECK(gpio_config(&io));
+    esp_err_t err = gpio_install_isr_service(0);
+    if (err != ESP_ERR_INVALID_STATE) ESP_ERROR_CHECK(err);
+    for (int k = 0; k < BTN_COUNT; k++) {
+        ESP_ERROR_CHECK(gpio_wakeup_enable(btns[k].pin, GPIO_INTR_LOW_LEVEL));
+        ESP_ERROR_CHECK(gpio_isr_handler_add(btns[k].pin, btn_isr, (void *)(intptr_t)k));
+    }
+    ESP_ERROR_CHECK(esp_sleep_enable_gpio_wakeup());
 }
 
-static inline int read_btn(gpio_num_t pin) {
-    return (gpio_get_level(pin) == 0); 
+static int64_t repeat_interval(uint16_t n) {
+    int64_t iv = BTN_REPEAT_START_US - (int64_t)n * BTN_REPEAT_ACCEL_US;
+    return (iv < BTN_REPEAT_MIN_US) ? BTN_REPEAT_MIN_US : iv;
 }
 
-static int debounce_once(DebBtn *b, TickType_t now, int *rising_edge) {
-    int raw = !gpio_get_level(b->pin); 
-    *rising_edge = 0;
-    if (raw != b->last_raw) {
-        b->tstamp = now;
-        b->last_raw = raw;
-    } else {
-        if ((now - b->tstamp) >= pdMS_TO_TICKS(10)) { 
-            if (raw != b->stable) {
-                if (raw == 1) *rising_edge = 1;
-                b->stable = raw;
+static bool emit(int k, BtnEvType type, uint16_t count, int64_t t, BtnEvent *out) {
+    out->btn = (uint8_t)k;
+    out->type = (uint8_t)type;
+    out->count = count;
+    out->t_us = t;
+    return true;
+}
+
+static bool accept(int k, bool down, int64_t t, BtnEvent *out) {
+    Btn *b = &btns[k];
+    b->down = down;
+    b->long_sent = false;
+    b->t_accept = t;
+    b->settle_at = 0;
+    b->repeats = 0;
+    return emit(k, down ? BTN_EV_PRESS : BTN_EV_RELEASE, 1, t, out);
+}
+
+// Returns one event, or false once wait has passed without any.
+bool buttons_get(BtnEvent *out, TickType_t wait, bool repeat) {
+    TickType_t start = xTaskGetTickCount();
+    for (;;) {
+        int64_t now = esp_timer_get_time();
+        int64_t next = INT64_MAX;
+        uint32_t lost = __atomic_exchange_n(&lost_mask, 0, __ATOMIC_RELAXED);
+        for (int k = 0; k < BTN_COUNT; k++) {
+            Btn *b = &btns[k];
+            if ((lost & (1u << k)) && !b->settle_at) b->settle_at = now;
+            if (b->settle_at && now >= b->settle_at) {
+                bool down = !gpio_get_level(b->pin);
+                b->settle_at = 0;
+                if (down != b->down) return accept(k, down, now, out);
+            }
+            if (b->down && !b->long_sent && now >= b->t_accept + BTN_LONG_US) {
+                b->long_sent = true;
+                b->next_repeat = b->t_accept + BTN_LONG_US;
+                return emit(k, BTN_EV_LONG, 1, now, out);
             }
+            bool repeating = b->down && b->long_sent && (BTN_REPEAT_MASK & (1u << k));
+            if (repeating && !repeat) {
+                // Start afresh if a later call turns repeat on mid-hold.
+                b->next_repeat = now + repeat_interval(b->repeats);
+                repeating = false;
+            }
+            if (repeating && now >= b->next_repeat) {
+                uint16_t n = 0;
+                while (now >= b->next_repeat && n < UINT16_MAX) {
+                    b->next_repeat += repeat_interval(b->repeats++);
+                    n++;
+                }
+                return emit(k, BTN_EV_REPEAT, n, now, out);
+            }
+            if (b->settle_at && b->settle_at < next) next = b->settle_at;
+            if (b->down && !b->long_sent && b->t_accept + BTN_LONG_US < next) next = b->t_accept + BTN_LONG_US;
+            if (repeating && b->next_repeat < next) next = b->next_repeat;
+        }
+        TickType_t left = portMAX_DELAY;
+        if (wait != portMAX_DELAY) {
+            TickType_t used = xTaskGetTickCount() - start;
+            left = (used >= wait) ? 0 : wait - used;
+        }
+        TickType_t to = left;
+        if (next != INT64_MAX) {
+            TickType_t t = pdMS_TO_TICKS((next - now + 999) / 1000) + 1;
+            if (t < to) to = t;
+        }
+        RawEdge r;
+        if (xQueueReceive(raw_q, &r, to) == pdTRUE) {
+            if (r.synth && r.type == BTN_EV_REPEAT && !repeat) continue;
+            if (r.synth) return emit(r.idx, (BtnEvType)r.type, r.count, r.t_us, out);
+            Btn *b = &btns[r.idx];
+            if ((bool)r.down == b->down) continue;
+            if (r.t_us - b->t_accept < BTN_LOCKOUT_US) {
+                b->settle_at = b->t_accept + BTN_LOCKOUT_US;
+                continue;
+            }
+            return accept(r.idx, r.down, r.t_us, out);
         }
+        if (to == left && left != portMAX_DELAY) return false;
     }
-    return b->stable;
 }
 
-typedef struct {
-    int ok_edge;
-    int back_edge;
-    int next_edge;
-    int cancel_edge;
-} BtnEdges;
+void buttons_inject(const BtnEvent *ev) {
+    RawEdge r = { .idx = ev->btn, .synth = 1, .type = ev->type, .count = ev->count, .t_us = esp_timer_get_time() };
+    xQueueSend(raw_q, &r, portMAX_DELAY);
+}
 
-void scan_buttons(BtnEdges *e) {
-    TickType_t now = xTaskGetTickCount();
-    debounce_once(&db_ok, now,     &e->ok_edge);
-    debounce_once(&db_back, now,   &e->back_edge);
-    debounce_once(&db_next, now,   &e->next_edge);
-    debounce_once(&db_cancel, now, &e->cancel_edge);
-}
\ No newline at end of file
+void buttons_edges(const BtnEvent *ev, BtnEdges *e) {
+    int n;
+    if (ev->type == BTN_EV_PRESS) n = 1;
+    else if (ev->type == BTN_EV_REPEAT) n = ev->count;
+    else return;
+    switch (ev->btn) {
+    case BTN_OK:     e->ok_edge = n; break;
+    case BTN_BACK:   e->back_edge = n; break;
+    case BTN_NEXT:   e->next_edge = n; break;
+    case BTN_CANCEL: e->cancel_edge = n; break;
+    }
+}
@@ -3,11 +3,35 @@
 #define BTN_BACK_PIN   16
 #define BTN_NEXT_PIN   15
 #define BTN_CANCEL_PIN 6
+#include <stdbool.h>
+#include <stdint.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "driver/gpio.h"
 #include "esp_err.h"
 
+// GPIO interrupts timestamp raw edges; buttons_get() debounces them and
+// hands out press/release/long-press events, blocking in between. A press
+// is reported on its first edge, later edges within the lockout are bounce.
+// NEXT/BACK held past BTN_LONG_US auto-repeat, the interval shrinking from
+// START to MIN by ACCEL per repeat. Repeats that fell due while the caller
+// was busy (drawing) arrive as one event with count > 1.
+#define BTN_LOCKOUT_US       20000
+#define BTN_LONG_US          600000
+#define BTN_REPEAT_START_US  200000
+#define BTN_REPEAT_MIN_US    40000
+#define BTN_REPEAT_ACCEL_US  15000
+
+typedef enum { BTN_OK, BTN_BACK, BTN_NEXT, BTN_CANCEL, BTN_COUNT } BtnId;
+typedef enum { BTN_EV_PRESS, BTN_EV_RELEASE, BTN_EV_LONG, BTN_EV_REPEAT } BtnEvType;
+
+typedef struct {
+    uint8_t btn;       // BtnId
+    uint8_t type;      // BtnEvType
+    uint16_t count;    // repeats folded into this event (1 otherwise)
+    int64_t t_us;      // esp_timer time of the accepted edge
+} BtnEvent;
+
 typedef struct {
     int ok_edge;
     int back_edge;
@@ -16,4 +40,10 @@ typedef struct {
 } BtnEdges;
 
 void buttons_init(void);
-void scan_buttons(BtnEdges *e);
+// repeat: the current screen wants auto-repeat. Without it a held button
+// only reports LONG and no repeat wakeups are scheduled.
+bool buttons_get(BtnEvent *out, TickType_t wait, bool repeat);
+// Press -> edge of 1, REPEAT -> edge of its count.
+void buttons_edges(const BtnEvent *ev, BtnEdges *e);
+// Queue an already debounced event as if it had just happened (replay).
+void buttons_inject(const BtnEvent *ev);
@@ -9,14 +9,8 @@
 #include "display.h"
 #include "reminders_store.h"
 #include "time_utils.h"
-
-const char* CONTENT_PRESETS[] = {
-    "BAO THUC", "HOP SANG", "HOP CHIEU", "TAP THE DUC",
-    "UONG THUOC", "NHAC HANH LY", "GOI DIEN", "KHOI HANH",
-    "DI CHO", "DON TRE", "NHAC LAM VIEC", "NHAC SINH NHAT"
-};
-
-const int NUM_CONTENT_PRESETS = (int)(sizeof(CONTENT_PRESETS)/sizeof(CONTENT_PRESETS[0]));
+#include "due_index.h"
+#include "time_service.h"
 
 static bool idle_screen_inited = false;
 static int center_x(const char *s) { return (TFT_WIDTH - (int)strlen(s)*FONT_W)/2; }
@@ -29,27 +23,32 @@ FieldSel field_sel = SEL_HOUR;
 int submenu_index = 0; 
 UiState ui_state = UI_IDLE;
 
-static inline int status_rank(const char* s) {
-    if (!s) return 2;
-    if (strncmp(s, "pending", 7)  == 0) return 1;
-    if (strncmp(s, "repeat",  6)  == 0) return 0;
-    return 2;
+static const int      STATUS_RANK[]  = { [REM_STATUS_PENDING] = 1, [REM_STATUS_COMPLETED] = 2, [REM_STATUS_REPEAT] = 0 };
+static const char*    STATUS_LABEL[] = { [REM_STATUS_PENDING] = "PENDING", [REM_STATUS_COMPLETED] = "COMPLETED", [REM_STATUS_REPEAT] = "REPEAT" };
+static const uint16_t STATUS_COLOR[] = { [REM_STATUS_PENDING] = COLOR_PENDING, [REM_STATUS_COMPLETED] = COLOR_COMPLETED, [REM_STATUS_REPEAT] = COLOR_REPEAT };
+
+static inline int status_rank(ReminderStatus s)           { return STATUS_RANK[s]; }
+static inline const char* status_label(ReminderStatus s)  { return STATUS_LABEL[s]; }
+static inline uint16_t status_color(ReminderStatus s)     { return STATUS_COLOR[s]; }
+
+// Renderers read a copy refreshed only when the store publishes. The idle
+// screen (print_time_task) and the menus (ui_task) each keep their own so
+// neither refreshes a copy the other is drawing from.
+static ReminderSnapshot idle_view, menu_view;
+
+static const ReminderSnapshot *ui_view(ReminderSnapshot *view) {
+    if (view->version != reminders_version()) reminders_snapshot(view);
+    return view;
 }
 
-static const char* status_label(const char* s) {
-    if (!s) return "";
-    if (!strncmp(s, "pending",   7)) return "PENDING";
-    if (!strncmp(s, "completed", 9)) return "COMPLETED";
-    if (!strncmp(s, "repeat",    6)) return "REPEAT";
-    return "";
+// Rows past count are stale: publish copies only live ones.
+static bool view_has(const ReminderSnapshot *v, int i) {
+    return i >= 0 && i < v->count;
 }
 
-static inline uint16_t status_color(const char* s) {
-    if (!s) return COLOR_WHITE;
-    if (!strncmp(s, "pending",   7)) return COLOR_PENDING;
-    if (!strncmp(s, "completed", 9)) return COLOR_COMPLETED;
-    if (!strncmp(s, "repeat",    6)) return COLOR_REPEAT;
-    return COLOR_WHITE;
+static int view_index_by_id(const ReminderSnapshot *v, int id) {
+    for (int i = 0; i < v->count; i++) if (v->rec[i].id == id) return i;
+    return -1;
 }
 
 void show_alarm_feedback(const char *msg, uint16_t color) {
@@ -61,86 +60,64 @@ void show_alarm_feedback(const char *msg, uint16_t color) {
     draw_string(x, y, msg, color);
 }
 
-void idle_draw_upcoming(const struct tm* now_local) {
-    if (!now_local) return;
+void idle_draw_upcoming(time_t now) {
     const int base_y = idle_y + FONT_H + 6 + 12;  
     const int line_h = 12;
-    struct tm now_tm = *now_local;
-    now_tm.tm_sec = 0;
-    time_t now_ts = mktime(&now_tm);  
-	typedef struct { int idx; int rank; int days_until; int min_in_day; } Slot;
-	Slot top[3] = { {-1,99,INT_MAX,INT_MAX}, {-1,99,INT_MAX,INT_MAX}, {-1,99,INT_MAX,INT_MAX} };
-	int now_total_min = now_local->tm_hour*60 + now_local->tm_min;
-	xSemaphoreTake(reminders_mutex, portMAX_DELAY);
-	for (int i = 0; i < num_reminders; i++) {
-    	const Reminder *r = &reminders[i];
-    	if (strncmp(r->status, "completed", 9) == 0) continue; 
-    	int rank = status_rank(r->status); 
-    	int days_until = 0;
-    	int min_in_day = 0;
-    	if (strncmp(r->status, "repeat", 6) == 0) {
-        	int ev_total_min = r->hour*60 + r->minute;
-        	if (ev_total_min >= now_total_min) {
-            	days_until = 0;
-            	min_in_day = ev_total_min - now_total_min;
-        	} else {
-            	days_until = 1;
-            	min_in_day = ev_total_min + 1440 - now_total_min;
-        	}
-    	} else {
-        	int y,m,d; parse_date(r->date, &y,&m,&d);
-        	struct tm ev = *now_local;
-        	ev.tm_year = y - 1900; ev.tm_mon = m - 1; ev.tm_mday = d;
-        	ev.tm_hour = r->hour;  ev.tm_min = r->minute; ev.tm_sec = 0;
-        	time_t now_ts = mktime((struct tm*)now_local);
-        	time_t ev_ts  = mktime(&ev);
-        	long delta_min = (long)((ev_ts - now_ts)/60);
-        	if (delta_min < 0) continue;             
-        	days_until = (int)(delta_min / 1440);    
-        	min_in_day = (int)(delta_min % 1440);   
-    	}
-    	for (int k=0; k<3; k++) {
-        	if (rank < top[k].rank ||
-        	(rank == top[k].rank && (days_until < top[k].days_until ||
-           	(days_until == top[k].days_until && min_in_day < top[k].min_in_day)))) {
-            	for (int t=2; t>k; t--) top[t] = top[t-1];
-            	top[k].idx = i; top[k].rank = rank;
-            	top[k].days_until = days_until; top[k].min_in_day = min_in_day;
-            	break;
-        	}
-    	}
-	}
-	xSemaphoreGive(reminders_mutex);
-	fill_rect(0, base_y - 2, TFT_WIDTH, line_h*3 + 4, COLOR_BLACK);
-	for (int row = 0; row < 3; row++) {
-    	int y = base_y + row * line_h;
-    	if (top[row].idx < 0) continue;
-    	Reminder r;
-    	xSemaphoreTake(reminders_mutex, portMAX_DELAY);
-    	r = reminders[top[row].idx];
-    	xSemaphoreGive(reminders_mutex);
-    	char hhmm[6]; fmt_time(r.hour, r.minute, hhmm);
-    	const char* st = status_label(r.status);
-    	char st_bracket[16]; snprintf(st_bracket, sizeof(st_bracket), "[%s]", st);
-    	int status_len = (int)strlen(st_bracket);
-    	int max_chars     = TFT_WIDTH / FONT_W;   
-    	int fixed_prefix  = 6;                    
-    	int avail_content = max_chars - fixed_prefix - 1 - status_len;
-    	if (avail_content < 0) avail_content = 0;
-    	char content_cut[32];
-    	snprintf(content_cut, sizeof(content_cut), "%.*s", avail_content, r.content);
-    	char prefix[64];
-    	snprintf(prefix, sizeof(prefix), "%s %s ", hhmm, content_cut);
-    	fill_rect(0, y, TFT_WIDTH, line_h, COLOR_BLACK);
-    	draw_string(4, y, prefix, COLOR_WHITE);
-    	int sx = 4 + (int)strlen(prefix) * FONT_W;
-    	draw_string(sx, y, st_bracket, status_color(r.status));
-	}
+    const ReminderSnapshot *v = ui_view(&idle_view);
+    // The published due order can lag the clock: drop past one-shots and
+    // roll past repeats forward to their next occurrence before ranking.
+    time_t floor_ts = now - civil_local_sec_of_day(now) % 60;
+    DueEntry due[MAX_REMINDERS];
+    int n_due = 0;
+    for (int k = 0; k < v->n_due; k++) {
+        DueEntry e = v->due[k];
+        int i = view_index_by_id(v, e.id);
+        if (i < 0) continue;
+        if (e.at < floor_ts) {
+            if (v->rec[i].status != REM_STATUS_REPEAT) continue;
+            e.at = reminder_next_fire(&v->rec[i], floor_ts);
+            if (e.at < 0) continue;
+        }
+        int j = n_due++;
+        while (j > 0 && due[j - 1].at > e.at) { due[j] = due[j - 1]; j--; }
+        due[j] = e;
+    }
+    int top[3];
+    int n_top = 0;
+    for (int rank = 0; rank < 3 && n_top < 3; rank++) {
+        for (int k = 0; k < n_due && n_top < 3; k++) {
+            int i = view_index_by_id(v, due[k].id);
+            if (status_rank(v->rec[i].status) != rank) continue;
+            top[n_top++] = i;
+        }
+    }
+    fill_rect(0, base_y - 2, TFT_WIDTH, line_h*3 + 4, COLOR_BLACK);
+    for (int row = 0; row < n_top; row++) {
+        int y = base_y + row * line_h;
+        const Reminder *r = &v->rec[top[row]];
+        char hhmm[6]; fmt_time(reminder_hour(r), reminder_min(r), hhmm);
+        const char* st = status_label(r->status);
+        char st_bracket[16]; snprintf(st_bracket, sizeof(st_bracket), "[%s]", st);
+        int status_len = (int)strlen(st_bracket);
+        int max_chars     = TFT_WIDTH / FONT_W;   
+        int fixed_prefix  = 6;                    
+        int avail_content = max_chars - fixed_prefix - 1 - status_len;
+        if (avail_content < 0) avail_content = 0;
+        char content_cut[32];
+        snprintf(content_cut, sizeof(content_cut), "%.*s", avail_content, v->content[top[row]]);
+        char prefix[64];
+        snprintf(prefix, sizeof(prefix), "%s %s ", hhmm, content_cut);
+        fill_rect(0, y, TFT_WIDTH, line_h, COLOR_BLACK);
+        draw_string(4, y, prefix, COLOR_WHITE);
+        int sx = 4 + (int)strlen(prefix) * FONT_W;
+        draw_string(sx, y, st_bracket, status_color(r->status));
+    }
 }
 
 void draw_idle_screen_now(void) {
-    time_t now; struct tm ti;
-    time(&now); localtime_r(&now, &ti);
+    TimeNow tn;
+    timesvc_read(&tn);
+    const struct tm ti = tn.tm;
     fill_screen(COLOR_BLACK);
     const char *title = "THOI GIAN HIEN TAI";
     draw_string((TFT_WIDTH - (int)strlen(title)*FONT_W)/2, 20, title, COLOR_GREEN);
@@ -192,42 +169,39 @@ void ui_draw_pick_list(const char *title) {
     static uint32_t last_epoch = (uint32_t)-1;
     static int prev_idx = -1;
     static int prev_base = -1;
+    static uint32_t prev_version = 0;
+    const ReminderSnapshot *v = ui_view(&menu_view);
     int base = (pick_index/6)*6;
-    if (last_epoch != ui_epoch || base != prev_base) {
+    if (last_epoch != ui_epoch || base != prev_base || prev_version != v->version) {
         fill_rect(0, 0, TFT_WIDTH, TFT_HEIGHT, COLOR_BLACK);
         draw_line_text(4, title, COLOR_GREEN);
-        xSemaphoreTake(reminders_mutex, portMAX_DELAY);
-        for (int i=0; i<6 && (base+i)<num_reminders; i++) {
+        for (int i=0; i<6 && (base+i)<v->count; i++) {
             char tt[6], buf[16];
-            fmt_time(reminders[base+i].hour, reminders[base+i].minute, tt);
+            fmt_time(reminder_hour(&v->rec[base+i]), reminder_min(&v->rec[base+i]), tt);
             snprintf(buf, sizeof(buf), "%c %s", (base+i)==pick_index?'>':' ', tt);
             draw_line_text(20 + i*12, buf, ((base+i)==pick_index)? COLOR_GREEN : COLOR_WHITE);
         }
-        xSemaphoreGive(reminders_mutex);
         draw_line_text(100, "OK:CHON  NEXT:LEN", COLOR_BLUE);
         draw_line_text(112, "BACK:XUONG", COLOR_BLUE);
         draw_line_text(124, "CANCEL:THOAT", COLOR_BLUE);
         prev_idx = pick_index;
         prev_base = base;
+        prev_version = v->version;
         last_epoch = ui_epoch;
         return;
     }
     if (prev_idx != pick_index) {
         int old_row = prev_idx - base;
         int new_row = pick_index - base;
-        if (old_row >=0 && old_row < 6) {
+        if (old_row >=0 && old_row < 6 && view_has(v, prev_idx)) {
             char tt[6], buf[16];
-            xSemaphoreTake(reminders_mutex, portMAX_DELAY);
-            fmt_time(reminders[prev_idx].hour, reminders[prev_idx].minute, tt);
-            xSemaphoreGive(reminders_mutex);
+            fmt_time(reminder_hour(&v->rec[prev_idx]), reminder_min(&v->rec[prev_idx]), tt);
             snprintf(buf, sizeof(buf), "  %s", tt);
             draw_line_text(20 + old_row*12, buf, COLOR_WHITE);
         }
-        if (new_row >=0 && new_row < 6) {
+        if (new_row >=0 && new_row < 6 && view_has(v, pick_index)) {
             char tt[6], buf[16];
-            xSemaphoreTake(reminders_mutex, portMAX_DELAY);
-            fmt_time(reminders[pick_index].hour, reminders[pick_index].minute, tt);
-            xSemaphoreGive(reminders_mutex);
+            fmt_time(reminder_hour(&v->rec[pick_index]), reminder_min(&v->rec[pick_index]), tt);
             snprintf(buf, sizeof(buf), "> %s", tt);
             draw_line_text(20 + new_row*12, buf, COLOR_GREEN);
         }
@@ -280,41 +254,36 @@ void ui_draw_list_content(const char *title) {
     static uint32_t last_epoch = (uint32_t)-1;
     static int prev_idx = -1;
     static int prev_base = -1;
-    static int prev_count = -1;            
+    static uint32_t prev_version = 0;
+    const ReminderSnapshot *v = ui_view(&menu_view);
     int base = (pick_index/6)*6;
-    if (last_epoch != ui_epoch || base != prev_base || prev_count != num_reminders) {
+    if (last_epoch != ui_epoch || base != prev_base || prev_version != v->version) {
         fill_rect(0, 0, TFT_WIDTH, TFT_HEIGHT, COLOR_BLACK);
         draw_line_text(4, title, COLOR_GREEN);
-        xSemaphoreTake(reminders_mutex, portMAX_DELAY);
-        for (int i=0; i<6 && (base+i)<num_reminders; i++) {
+        for (int i=0; i<6 && (base+i)<v->count; i++) {
             char line[20];
-            const char* name = reminders[base+i].content;
+            const char* name = v->content[base+i];
             snprintf(line, sizeof(line), "%c %.16s", (base+i)==pick_index?'>':' ', name);
             draw_line_text(20 + i*12, line, ((base+i)==pick_index)? COLOR_YELLOW : COLOR_WHITE);
         }
-        xSemaphoreGive(reminders_mutex);
         draw_line_text(100, "OK:CHON  NEXT:LEN", COLOR_BLUE);
         draw_line_text(112, "BACK:XUONG  CANCEL:THOAT", COLOR_BLUE);
         prev_idx   = pick_index;
         prev_base  = base;
-        prev_count = num_reminders;        
+        prev_version = v->version;
         last_epoch = ui_epoch;
         return;
     }
     if (prev_idx != pick_index) {
         int old_row = prev_idx - base, new_row = pick_index - base;
-        if (old_row>=0 && old_row<6) {
+        if (old_row>=0 && old_row<6 && view_has(v, prev_idx)) {
             char line[20];
-            xSemaphoreTake(reminders_mutex, portMAX_DELAY);
-            snprintf(line, sizeof(line), "  %.16s", reminders[prev_idx].content);
-            xSemaphoreGive(reminders_mutex);
+            snprintf(line, sizeof(line), "  %.16s", v->content[prev_idx]);
             draw_line_text(20 + old_row*12, line, COLOR_WHITE);
         }
-        if (new_row>=0 && new_row<6) {
+        if (new_row>=0 && new_row<6 && view_has(v, pick_index)) {
             char line[20];
-            xSemaphoreTake(reminders_mutex, portMAX_DELAY);
-            snprintf(line, sizeof(line), "> %.16s", reminders[pick_index].content);
-            xSemaphoreGive(reminders_mutex);
+            snprintf(line, sizeof(line), "> %.16s", v->content[pick_index]);
             draw_line_text(20 + new_row*12, line, COLOR_YELLOW);
         }
         prev_idx = pick_index;
@@ -358,24 +327,29 @@ void ui_draw_preset_list(const char *title) {
 void ui_draw_view_detail(void) {
     static uint32_t last_epoch = (uint32_t)-1;
     static int      last_idx   = -1;
-    if (last_epoch != ui_epoch || last_idx != pick_index) {
+    static uint32_t last_version = 0;
+    const ReminderSnapshot *v = ui_view(&menu_view);
+    if (last_epoch != ui_epoch || last_idx != pick_index || last_version != v->version) {
         fill_rect(0, 0, TFT_WIDTH, TFT_HEIGHT, COLOR_BLACK);
         draw_line_text(4, "CHI TIET", COLOR_GREEN);
-        xSemaphoreTake(reminders_mutex, portMAX_DELAY);
-        Reminder r = reminders[pick_index];
-        xSemaphoreGive(reminders_mutex);
+        draw_line_text(100, "OK/CANCEL:QUAY LAI", COLOR_BLUE);
+        last_idx     = pick_index;
+        last_version = v->version;
+        last_epoch   = ui_epoch;
+        if (!view_has(v, pick_index)) return;
+        char date[11];
+        Reminder r = v->rec[pick_index];
+        const char *content = v->content[pick_index];
+        reminder_date_str(&r, date);
         draw_line_text(24, "NGAY:", COLOR_YELLOW);
-        draw_string(60, 24, r.date, COLOR_WHITE);
-        char hhmm[6]; fmt_time(r.hour, r.minute, hhmm);
+        draw_string(60, 24, date, COLOR_WHITE);
+        char hhmm[6]; fmt_time(reminder_hour(&r), reminder_min(&r), hhmm);
         draw_line_text(36, "GIO:", COLOR_YELLOW);
         draw_string(60, 36, hhmm, COLOR_WHITE);
         draw_line_text(56, "NOI DUNG:", COLOR_YELLOW);
         char line[22]; 
-        snprintf(line, sizeof(line), "%.20s", r.content);
+        snprintf(line, sizeof(line), "%.20s", content);
         draw_string(4, 68, line, COLOR_WHITE);
-        draw_line_text(100, "OK/CANCEL:QUAY LAI", COLOR_BLUE);
-        last_idx   = pick_index;
-        last_epoch = ui_epoch;
     }
 }
 
@@ -21,7 +21,8 @@ typedef enum {
     UI_ADD_DATE,       
     UI_ADD_TIME,       
     UI_DEL_PICK,        
-    UI_VIEW_DETAIL
+    UI_VIEW_DETAIL,
+    UI_STATE_COUNT
 } UiState;
 
 typedef enum { SEL_LEFT=0, SEL_RIGHT=1 } TwoSel;
@@ -29,8 +30,6 @@ typedef enum { SEL_LEFT=0, SEL_RIGHT=1 } TwoSel;
 typedef enum { SEL_HOUR = 0, SEL_MINUTE = 1 } FieldSel;
 
 extern UiState ui_state;
-extern const char* CONTENT_PRESETS[]; 
-extern const int NUM_CONTENT_PRESETS;
 extern int idle_x, idle_y;
 extern uint32_t ui_epoch;
 extern int preset_index; 
@@ -41,7 +40,7 @@ extern FieldSel field_sel;
 extern int submenu_index;
 
 void show_alarm_feedback(const char *msg, uint16_t color);
-void idle_draw_upcoming(const struct tm* now_local);
+void idle_draw_upcoming(time_t now);
 void draw_idle_screen_now(void);
 void idle_clock_screen_init(void);
 void ui_draw_menu(void);
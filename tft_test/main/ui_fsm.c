@@ -0,0 +1,58 @@
+#include "esp_log.h"
+#include "time_utils.h"
+#include "ui_fsm.h"
+
+#define TAG "UiFsm"
+
+static const UiTrans *rows;
+static const UiScreen *screens;
+typedef struct { uint8_t first, n; } Span;
+static Span span[UI_STATE_COUNT][BTN_COUNT];
+
+void ui_fsm_init(const UiTrans *r, size_t n_rows, const UiScreen *s) {
+    rows = r;
+    screens = s;
+    for (size_t k = 0; k < n_rows; k++) {
+        if (r[k].state >= UI_STATE_COUNT || r[k].btn >= BTN_COUNT || k > UINT8_MAX) {
+            ESP_LOGE(TAG, "Dong %u khong hop le", (unsigned)k);
+            continue;
+        }
+        Span *sp = &span[r[k].state][r[k].btn];
+        if (sp->n == 0) sp->first = (uint8_t)k;
+        else if (sp->first + sp->n != k) ESP_LOGE(TAG, "Dong %u khong lien tiep", (unsigned)k);
+        sp->n++;
+    }
+}
+
+void ui_fsm_goto(UiState s) {
+    const UiScreen *from = &screens[ui_state];
+    if (from->exit) from->exit();
+    ui_state = s;
+    ui_epoch++;
+    const UiScreen *to = &screens[s];
+    if (to->enter) to->enter();
+    if (to->render) to->render();
+}
+
+bool ui_fsm_dispatch(BtnId btn, int n) {
+    if (ui_state >= UI_STATE_COUNT || btn >= BTN_COUNT) return false;
+    const UiTrans *t = &rows[span[ui_state][btn].first];
+    for (int k = span[ui_state][btn].n; k > 0; k--, t++) {
+        if (t->guard && !t->guard()) continue;
+        if (t->act) t->act(n);
+        if (t->next != UI_STAY) ui_fsm_goto((UiState)t->next);
+        else if (screens[ui_state].render) screens[ui_state].render();
+        return true;
+    }
+    return false;
+}
+
+static void move(int delta) {
+    const UiScreen *s = &screens[ui_state];
+    if (!s->cursor) return;
+    int cnt = s->count ? *s->count : 0;
+    *s->cursor = (cnt > 0) ? wrap_step(*s->cursor, delta, 0, cnt - 1) : 0;
+}
+
+void ui_fsm_prev(int n) { move(-n); }
+void ui_fsm_next(int n) { move(n); }
@@ -0,0 +1,40 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "ui_buttons.h"
+#include "ui_draw.h"
+
+// Table-driven UI. Each row is (state, button, guard, action, next); rows
+// for the same state and button must be contiguous and the first whose
+// guard passes wins. Leaving a state runs its exit hook, entering runs
+// enter then render; UI_STAY re-renders in place. The ui_draw_* renderers
+// diff against what is already on screen, so a re-render is cheap.
+#define UI_STAY UI_STATE_COUNT
+
+typedef bool (*UiGuard)(void);
+typedef void (*UiAction)(int n);   // n = presses folded into the event
+
+typedef struct {
+    uint8_t  state;   // UiState
+    uint8_t  btn;     // BtnId
+    UiGuard  guard;   // NULL = always
+    UiAction act;     // NULL = none
+    uint8_t  next;    // UiState or UI_STAY
+} UiTrans;
+
+typedef struct {
+    void (*enter)(void);
+    void (*exit)(void);
+    void (*render)(void);
+    int       *cursor;   // list screens: NEXT/BACK move this with wrap
+    const int *count;
+} UiScreen;
+
+void ui_fsm_init(const UiTrans *rows, size_t n_rows, const UiScreen *screens);
+void ui_fsm_goto(UiState s);
+bool ui_fsm_dispatch(BtnId btn, int n);
+
+// Row actions for list screens; NEXT moves up, BACK moves down.
+void ui_fsm_prev(int n);
+void ui_fsm_next(int n);
@@ -0,0 +1,175 @@
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "display.h"
+#include "mqtt.h"
+#include "ui_trace.h"
+
+#define TAG "UiTrace"
+
+#if CONFIG_REMINDERS_UI_TRACE
+// Rough setup cost of one spi_device_polling_transmit on top of the bits.
+#define SPI_TXN_OVERHEAD_US 8
+
+typedef struct {
+    uint8_t  btn, type;
+    uint16_t count;
+    uint32_t gap_ms;
+} TraceEvt;
+
+typedef struct {
+    uint32_t pixels, bytes, txns;
+    uint32_t bus_us;   // modeled
+    uint32_t lat_us;   // key edge to last pixel sent
+} TraceCost;
+
+static TraceEvt rec[UI_TRACE_LEN];
+static int rec_head = 0, rec_n = 0;
+static int64_t rec_last_us = 0;
+
+static TraceCost costs[UI_TRACE_LEN];
+static volatile int cost_n = 0;
+static volatile bool replaying = false;
+static DisplayStats before;
+
+static TraceEvt *replay_evs = NULL;
+static int replay_n = 0, replay_speed = 1;
+
+void ui_trace_begin(void) {
+    display_stats(&before);
+}
+
+void ui_trace_end(const BtnEvent *ev) {
+    if (replaying) {
+        if (cost_n >= UI_TRACE_LEN) return;
+        DisplayStats after;
+        display_stats(&after);
+        TraceCost *c = &costs[cost_n];
+        c->pixels = after.pixels - before.pixels;
+        c->bytes  = after.bytes - before.bytes;
+        c->txns   = after.txns - before.txns;
+        c->bus_us = (uint32_t)((uint64_t)c->bytes * 8 * 1000000 / DISPLAY_SPI_HZ) + c->txns * SPI_TXN_OVERHEAD_US;
+        c->lat_us = (uint32_t)(esp_timer_get_time() - ev->t_us);
+        ESP_LOGI(TAG, "#%d btn=%u type=%u: %lu px, %lu B, %lu txn, bus %lu us, tre %lu us", cost_n,
+                 ev->btn, ev->type, (unsigned long)c->pixels, (unsigned long)c->bytes,
+                 (unsigned long)c->txns, (unsigned long)c->bus_us, (unsigned long)c->lat_us);
+        cost_n++;
+        return;
+    }
+    int64_t gap = rec_n ? (ev->t_us - rec_last_us) / 1000 : 0;
+    rec_last_us = ev->t_us;
+    TraceEvt *r = &rec[(rec_head + rec_n) % UI_TRACE_LEN];
+    if (rec_n < UI_TRACE_LEN) rec_n++;
+    else rec_head = (rec_head + 1) % UI_TRACE_LEN;
+    *r = (TraceEvt){ ev->btn, ev->type, ev->count, (uint32_t)(gap < 0 ? 0 : gap) };
+}
+
+static void publish_json(const char *topic, cJSON *json) {
+    char *str = cJSON_PrintUnformatted(json);
+    if (str) {
+        mqtt_publish(topic, str, 0, 0);
+        free(str);
+    }
+    cJSON_Delete(json);
+}
+
+static cJSON *event_array(const TraceEvt *e) {
+    int v[4] = { e->btn, e->type, e->count, (int)e->gap_ms };
+    return cJSON_CreateIntArray(v, 4);
+}
+
+void ui_trace_publish(void) {
+    cJSON *json = cJSON_CreateObject();
+    cJSON *arr = cJSON_AddArrayToObject(json, "events");
+    // Called from the MQTT task; a torn ring only costs a bogus entry.
+    for (int k = 0; k < rec_n; k++) cJSON_AddItemToArray(arr, event_array(&rec[(rec_head + k) % UI_TRACE_LEN]));
+    publish_json("reminders/ui_trace", json);
+}
+
+static void publish_report(void) {
+    cJSON *json = cJSON_CreateObject();
+    cJSON *arr = cJSON_AddArrayToObject(json, "reports");
+    TraceCost sum = {0}, worst = {0};
+    for (int k = 0; k < cost_n; k++) {
+        const TraceCost *c = &costs[k];
+        int v[5] = { (int)c->pixels, (int)c->bytes, (int)c->txns, (int)c->bus_us, (int)c->lat_us };
+        cJSON_AddItemToArray(arr, cJSON_CreateIntArray(v, 5));
+        sum.pixels += c->pixels; sum.bytes += c->bytes; sum.txns += c->txns; sum.bus_us += c->bus_us;
+        if (c->lat_us > worst.lat_us) worst = *c;
+    }
+    cJSON_AddNumberToObject(json, "events", cost_n);
+    cJSON_AddNumberToObject(json, "pixels", sum.pixels);
+    cJSON_AddNumberToObject(json, "bytes", sum.bytes);
+    cJSON_AddNumberToObject(json, "txns", sum.txns);
+    cJSON_AddNumberToObject(json, "bus_us", sum.bus_us);
+    cJSON_AddNumberToObject(json, "worst_lat_us", worst.lat_us);
+    publish_json("reminders/ui_trace/report", json);
+}
+
+static void replay_task(void *pv) {
+    ESP_LOGI(TAG, "Phat lai %d su kien, toc do x%d", replay_n, replay_speed);
+    cost_n = 0;
+    replaying = true;
+    for (int k = 0; k < replay_n; k++) {
+        const TraceEvt *e = &replay_evs[k];
+        if (e->gap_ms) vTaskDelay(pdMS_TO_TICKS(e->gap_ms / replay_speed) + 1);
+        BtnEvent ev = { .btn = e->btn, .type = e->type, .count = e->count ? e->count : 1 };
+        buttons_inject(&ev);
+    }
+    // ui_task reports each event once it has drawn; give it time to drain.
+    for (int k = 0; k < 100 && cost_n < replay_n; k++) vTaskDelay(pdMS_TO_TICKS(50));
+    replaying = false;
+    publish_report();
+    free(replay_evs);
+    replay_evs = NULL;
+    vTaskDelete(NULL);
+}
+
+// [btn, type, count, gap_ms], all numbers in range.
+static bool parse_event(const cJSON *e, TraceEvt *out) {
+    if (!cJSON_IsArray(e) || cJSON_GetArraySize(e) != 4) return false;
+    int v[4];
+    for (int k = 0; k < 4; k++) {
+        const cJSON *it = cJSON_GetArrayItem(e, k);
+        if (!cJSON_IsNumber(it)) return false;
+        v[k] = it->valueint;
+    }
+    if (v[0] < 0 || v[0] >= BTN_COUNT || v[1] < BTN_EV_PRESS || v[1] > BTN_EV_REPEAT) return false;
+    if (v[2] < 0 || v[2] > UINT16_MAX || v[3] < 0) return false;
+    *out = (TraceEvt){ (uint8_t)v[0], (uint8_t)v[1], (uint16_t)v[2], (uint32_t)v[3] };
+    return true;
+}
+
+bool ui_trace_replay(const cJSON *events, int speed) {
+    if (!cJSON_IsArray(events)) return false;
+    int n = cJSON_GetArraySize(events);
+    if (replay_evs || n <= 0) return false;
+    if (n > UI_TRACE_LEN) n = UI_TRACE_LEN;
+    TraceEvt *evs = calloc(n, sizeof(TraceEvt));
+    if (!evs) return false;
+    for (int k = 0; k < n; k++) {
+        if (!parse_event(cJSON_GetArrayItem(events, k), &evs[k])) {
+            ESP_LOGE(TAG, "Su kien %d khong hop le", k);
+            free(evs);
+            return false;
+        }
+    }
+    replay_evs = evs;
+    replay_n = n;
+    replay_speed = (speed > 0) ? speed : 1;
+    if (xTaskCreate(replay_task, "ui_replay", 3072, NULL, 4, NULL) != pdPASS) {
+        free(replay_evs);
+        replay_evs = NULL;
+        return false;
+    }
+    return true;
+}
+#else
+void ui_trace_begin(void) {}
+void ui_trace_end(const BtnEvent *ev) {}
+void ui_trace_publish(void) {}
+bool ui_trace_replay(const cJSON *events, int speed) { return false; }
+#endif
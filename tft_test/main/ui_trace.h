@@ -0,0 +1,20 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "cJSON.h"
+#include "ui_buttons.h"
+
+// Field recording and replay of UI input (CONFIG_REMINDERS_UI_TRACE).
+// Every button event is kept in a ring with its gap to the previous one;
+// {"action":"ui_trace"} on reminders/ui publishes it, {"action":"ui_replay",
+// "events":[[btn,type,count,gap_ms],...],"speed":n} feeds it back through
+// the button queue. Each event handled during a replay gets a cost report:
+// pixels, bytes and SPI transactions pushed while ui_task handled it, the
+// modeled bus time for those, and measured key-to-pixels latency. Other
+// tasks drawing at the same time are counted too.
+#define UI_TRACE_LEN 128
+
+void ui_trace_begin(void);
+void ui_trace_end(const BtnEvent *ev);
+void ui_trace_publish(void);
+bool ui_trace_replay(const cJSON *events, int speed);
@@ -0,0 +1,123 @@
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "vclock.h"
+#include "due_index.h"
+#include "scheduler.h"
+#include "timer_wheel.h"
+#include "time_service.h"
+
+#define TAG "VClock"
+
+#if CONFIG_REMINDERS_VCLOCK_SIM
+// Virtual time is base + (real elapsed since base_real) * rate; every
+// change re-bases so both clocks stay continuous (wall may jump on set).
+static portMUX_TYPE vc_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool     vc_started = false;
+static int64_t  vc_base_real = 0;
+static int64_t  vc_base_wall = 0;
+static int64_t  vc_base_mono = 0;
+static uint32_t vc_rate = 1;
+
+static void rebase_locked(int64_t real) {
+    if (!vc_started) {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        vc_base_wall = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+        vc_base_mono = real;
+        vc_started = true;
+    } else {
+        int64_t d = (real - vc_base_real) * vc_rate;
+        vc_base_wall += d;
+        vc_base_mono += d;
+    }
+    vc_base_real = real;
+}
+
+static int64_t elapsed_locked(int64_t real) {
+    if (!vc_started) rebase_locked(real);
+    return (real - vc_base_real) * vc_rate;
+}
+
+int64_t vclock_now_us(void) {
+    int64_t real = esp_timer_get_time();
+    portENTER_CRITICAL(&vc_lock);
+    int64_t t = vc_base_wall + elapsed_locked(real);
+    portEXIT_CRITICAL(&vc_lock);
+    return t;
+}
+
+int64_t vclock_mono_us(void) {
+    int64_t real = esp_timer_get_time();
+    portENTER_CRITICAL(&vc_lock);
+    int64_t t = vc_base_mono + elapsed_locked(real);
+    portEXIT_CRITICAL(&vc_lock);
+    return t;
+}
+
+TickType_t vclock_ticks(int64_t us) {
+    if (us <= 0) return 0;
+    uint32_t rate = vclock_rate();
+    return pdMS_TO_TICKS((us / rate + 999) / 1000) + 1;
+}
+
+uint32_t vclock_rate(void) {
+    return __atomic_load_n(&vc_rate, __ATOMIC_RELAXED);
+}
+
+// Sleepers computed their timeouts against the old clock: wake them to
+// re-plan, and rebuild the due index as after an SNTP step.
+static void clock_changed(void) {
+    due_index_invalidate();
+    timesvc_refresh();
+    sched_kick();
+    tw_kick();
+}
+
+void vclock_set(time_t at) {
+    int64_t real = esp_timer_get_time();
+    portENTER_CRITICAL(&vc_lock);
+    rebase_locked(real);
+    vc_base_wall = (int64_t)at * 1000000;
+    portEXIT_CRITICAL(&vc_lock);
+    ESP_LOGW(TAG, "Đặt đồng hồ ảo: %lld", (long long)at);
+    clock_changed();
+}
+
+void vclock_set_rate(uint32_t rate) {
+    if (rate < 1) rate = 1;
+    if (rate > VCLOCK_MAX_RATE) rate = VCLOCK_MAX_RATE;
+    int64_t real = esp_timer_get_time();
+    portENTER_CRITICAL(&vc_lock);
+    rebase_locked(real);
+    vc_rate = rate;
+    portEXIT_CRITICAL(&vc_lock);
+    ESP_LOGW(TAG, "Tốc độ đồng hồ ảo: x%u", (unsigned)rate);
+    clock_changed();
+}
+
+#else
+
+int64_t vclock_now_us(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+int64_t vclock_mono_us(void) {
+    return esp_timer_get_time();
+}
+
+TickType_t vclock_ticks(int64_t us) {
+    if (us <= 0) return 0;
+    return pdMS_TO_TICKS((us + 999) / 1000) + 1;
+}
+
+#endif
+
+time_t vclock_now(void) {
+    return (time_t)(vclock_now_us() / 1000000);
+}
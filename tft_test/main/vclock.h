@@ -0,0 +1,24 @@
+#pragma once
+#include <stdint.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+
+// Single time source for the scheduler, alarm and UI paths. Normally a thin
+// wrapper over the system clock and esp_timer. With
+// CONFIG_REMINDERS_VCLOCK_SIM both clocks become virtual: they can be set
+// and run up to VCLOCK_MAX_RATE times faster than real time, and every wait
+// expressed through vclock_ticks() shrinks by the same factor, so days of
+// alarms, snoozes and repeats play out in minutes.
+#define VCLOCK_MAX_RATE 3600
+
+time_t     vclock_now(void);
+int64_t    vclock_now_us(void);       // wall clock, microseconds
+int64_t    vclock_mono_us(void);      // never jumps; drives the timer wheel
+TickType_t vclock_ticks(int64_t us);  // real ticks for a virtual duration, rounded up
+
+#if CONFIG_REMINDERS_VCLOCK_SIM
+void     vclock_set(time_t at);
+void     vclock_set_rate(uint32_t rate);
+uint32_t vclock_rate(void);
+#endif